@@ -15,13 +15,6 @@ namespace v4 {
             addr{sockaddr.sin_addr.s_addr},
             port{sockaddr.sin_port} {
     }
-    [[nodiscard]] constexpr ::sockaddr_in address::to_sockaddr() const noexcept {
-        ::sockaddr_in out;
-        out.sin_family = AF_INET;
-        out.sin_port = this->port;
-        out.sin_addr.s_addr = this->addr;
-        return out;
-    }
 } // namespace v4
 
 namespace v6 {
@@ -37,13 +30,5 @@ namespace v6 {
             scope_id{0},
             port{sockaddr.sin6_port} {
     }
-    [[nodiscard]] constexpr ::sockaddr_in6 address::to_sockaddr() const noexcept {
-        ::sockaddr_in6 out;
-        out.sin6_family = AF_INET6;
-        out.sin6_port = this->port;
-        std::copy(this->addr.cbegin(), this->addr.cend(), out.sin6_addr.s6_addr);
-
-        return out;
-    }
 } // namespace v6
 }; // namespace n3::net
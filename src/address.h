@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <concepts>
 #include <cstdint>
@@ -28,7 +29,15 @@ namespace v4 {
     public:
         address() noexcept;
         address(const ::sockaddr_in& sockaddr) noexcept;
-        [[nodiscard]] constexpr ::sockaddr_in to_sockaddr() const noexcept;
+
+        //Defined inline since constexpr functions can't be used from other translation units
+        [[nodiscard]] constexpr ::sockaddr_in to_sockaddr() const noexcept {
+            ::sockaddr_in out{};
+            out.sin_family = AF_INET;
+            out.sin_port = this->port;
+            out.sin_addr.s_addr = this->addr;
+            return out;
+        }
     };
 
 } // namespace v4
@@ -44,7 +53,15 @@ namespace v6 {
     public:
         address() noexcept;
         address(const ::sockaddr_in6& sockaddr) noexcept;
-        [[nodiscard]] constexpr ::sockaddr_in6 to_sockaddr() const noexcept;
+
+        //Defined inline since constexpr functions can't be used from other translation units
+        [[nodiscard]] constexpr ::sockaddr_in6 to_sockaddr() const noexcept {
+            ::sockaddr_in6 out{};
+            out.sin6_family = AF_INET6;
+            out.sin6_port = this->port;
+            std::copy(this->addr.cbegin(), this->addr.cend(), out.sin6_addr.s6_addr);
+            return out;
+        }
     };
 } // namespace v6
 
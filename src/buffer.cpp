@@ -1,11 +1,22 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <linux/mman.h>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <ranges>
+#include <unordered_map>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 
 #include "buffer.h"
 
+#include "error.h"
+#include "handle.h"
 #include "page_size.h"
 #include "syscalls.h"
 
@@ -19,14 +30,236 @@ OwningBuffer::OwningBuffer(std::span<std::byte> init_data) :
 OwningBuffer::OwningBuffer(std::vector<std::byte>&& init_data) : data{init_data} {
 }
 
-//TODO: Use mmap to guarantee a page instead of doing so indirectly via operator new allocation
-PageBuffer::PageBuffer() :
+page_arena::page_arena(const bool use_hugetlb) :
         page_size{GetPageSize()},
-        underlying{[] {
-            const auto ps = GetPageSize();
-            return std::unique_ptr<std::byte[]>(reinterpret_cast<std::byte *>(
-                    ::operator new[](ps, static_cast<std::align_val_t>(ps))));
-        }()} {
+        try_hugetlb{use_hugetlb},
+        lock{},
+        regions{} {
+    assert(REGION_SIZE % this->page_size == 0);
+}
+
+page_arena::~page_arena() {
+    for (const auto& r : this->regions | std::views::values) {
+        assert(r.in_use == 0);
+        ::munmap(r.base, REGION_SIZE);
+    }
+}
+
+[[nodiscard]] page_arena& page_arena::global() {
+    //Never destroyed, PageBuffers in other statics may outlive it otherwise
+    static auto *const arena = new page_arena{};
+    return *arena;
+}
+
+[[nodiscard]] page_arena::region& page_arena::map_region() {
+    constexpr int PROT = PROT_READ | PROT_WRITE;
+    constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+    //Regions are exactly one MAP_HUGE_2MB page
+    static_assert(REGION_SIZE == 2 * 1024 * 1024);
+
+    void *base = MAP_FAILED;
+    auto kind = backing::hugetlb;
+    if (this->try_hugetlb) {
+        /*
+         * Explicitly 2MB, without a size MAP_HUGETLB takes the default huge page size (maybe 1GB)
+         * Fails with ENOMEM when no huge pages are reserved, which is the default on most systems,
+         * or EINVAL when 2MB isn't a supported huge page size, either way THP is the fallback
+         */
+        base = ::mmap(nullptr, REGION_SIZE, PROT, FLAGS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    }
+    if (base == MAP_FAILED) {
+        kind = backing::transparent;
+        //Over map so a REGION_SIZE aligned window fits, then trim off both ends
+        auto *const raw = static_cast<std::byte *>(
+                ::mmap(nullptr, REGION_SIZE * 2, PROT, FLAGS, -1, 0));
+        if (raw == MAP_FAILED) {
+            throw std::bad_alloc{};
+        }
+        const auto addr = reinterpret_cast<uintptr_t>(raw);
+        const auto head = ((addr + REGION_SIZE - 1) & ~(REGION_SIZE - 1)) - addr;
+        if (head > 0) {
+            ::munmap(raw, head);
+        }
+        if (head < REGION_SIZE) {
+            ::munmap(raw + head + REGION_SIZE, REGION_SIZE - head);
+        }
+        base = raw + head;
+        //Best effort, THP may be disabled system wide
+        ::madvise(base, REGION_SIZE, MADV_HUGEPAGE);
+    }
+
+    //Huge pages are naturally aligned to their size, the THP path aligned the window itself
+    assert((reinterpret_cast<uintptr_t>(base) & (REGION_SIZE - 1)) == 0);
+
+    try {
+        const auto pages = static_cast<uint32_t>(REGION_SIZE / this->page_size);
+        std::vector<uint32_t> free_pages;
+        free_pages.reserve(pages);
+        //Reversed so pages go out front to back and the region faults in sequentially
+        for (uint32_t idx = pages; idx > 0; --idx) {
+            free_pages.push_back(idx - 1);
+        }
+        return this->regions
+                .emplace(reinterpret_cast<uintptr_t>(base),
+                        region{
+                                .base = static_cast<std::byte *>(base),
+                                .kind = kind,
+                                .free_pages = std::move(free_pages),
+                                .in_use = 0,
+                                .released = false,
+                        })
+                .first->second;
+    } catch (...) {
+        ::munmap(base, REGION_SIZE);
+        throw;
+    }
+}
+
+void page_arena::release_idle(region& idle) noexcept {
+    assert(idle.in_use == 0);
+    if (idle.kind == backing::hugetlb) {
+        //No MADV_FREE for hugetlb, unmapping is the only way to return pages to the pool
+        ::munmap(idle.base, REGION_SIZE);
+        idle.base = nullptr;
+        return;
+    }
+    //Pre 4.5 kernels don't have MADV_FREE, dropping the pages right away is the closest thing
+    if (::madvise(idle.base, REGION_SIZE, MADV_FREE) == -1) {
+        ::madvise(idle.base, REGION_SIZE, MADV_DONTNEED);
+    }
+    idle.released = true;
+}
+
+[[nodiscard]] std::byte *page_arena::allocate() {
+    const std::lock_guard guard{this->lock};
+
+    //Fullest region with room first, so the others can drain and be given back
+    region *best = nullptr;
+    for (auto& r : this->regions | std::views::values) {
+        if (!r.free_pages.empty() && (!best || r.in_use > best->in_use)) {
+            best = &r;
+        }
+    }
+    if (!best) {
+        best = &this->map_region();
+    }
+
+    const auto idx = best->free_pages.back();
+    best->free_pages.pop_back();
+    ++best->in_use;
+    //Touching a MADV_FREE page cancels the advice, nothing to undo
+    best->released = false;
+    return best->base + (idx * this->page_size);
+}
+
+void page_arena::deallocate(std::byte *const page) noexcept {
+    const std::lock_guard guard{this->lock};
+
+    const auto it = this->regions.find(reinterpret_cast<uintptr_t>(page) & ~(REGION_SIZE - 1));
+    assert(it != this->regions.end());
+    auto& owner = it->second;
+    //Reserved for every page up front, so this never allocates
+    owner.free_pages.push_back(static_cast<uint32_t>((page - owner.base) / this->page_size));
+    --owner.in_use;
+    if (owner.in_use > 0) {
+        return;
+    }
+
+    //Keep one idle region warm so a connection burst doesn't fault a fresh region in every time
+    const auto idle = std::ranges::count_if(this->regions | std::views::values,
+            [](const region& r) { return r.in_use == 0 && !r.released; });
+    if (idle > 1) {
+        this->release_idle(owner);
+        if (owner.base == nullptr) {
+            this->regions.erase(it);
+        }
+    }
+}
+
+void page_arena::trim() noexcept {
+    const std::lock_guard guard{this->lock};
+    for (auto& r : this->regions | std::views::values) {
+        if (r.in_use == 0 && !r.released) {
+            this->release_idle(r);
+        }
+    }
+    std::erase_if(this->regions, [](const auto& entry) { return entry.second.base == nullptr; });
+}
+
+[[nodiscard]] size_t page_arena::region_count() noexcept {
+    const std::lock_guard guard{this->lock};
+    return this->regions.size();
+}
+
+[[nodiscard]] size_t page_arena::pages_in_use() noexcept {
+    const std::lock_guard guard{this->lock};
+    return std::ranges::fold_left(
+            this->regions | std::views::values | std::views::transform(&region::in_use),
+            size_t{0},
+            std::plus<size_t>());
+}
+
+PageBuffer::PageBuffer(page_arena& arena) :
+        page_size{GetPageSize()},
+        underlying{arena.allocate(), page_arena::page_delete{&arena}} {
+}
+
+RingBuffer::RingBuffer(const size_t min_capacity) :
+        base{nullptr},
+        cap{std::max<size_t>(1, (min_capacity + GetPageSize() - 1) / GetPageSize())
+                * GetPageSize()},
+        head{0},
+        count{0} {
+    const OwnedHandle fd{::memfd_create("n3_ring", MFD_CLOEXEC)};
+    if (fd < 0) {
+        throw error::get_error_code_from_errno(errno);
+    }
+    if (::ftruncate(fd, static_cast<off_t>(this->cap)) == -1) {
+        throw error::get_error_code_from_errno(errno);
+    }
+
+    //Reserve both halves first so nothing else can land in the second one
+    auto *const reserved = static_cast<std::byte *>(
+            ::mmap(nullptr, this->cap * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (reserved == MAP_FAILED) {
+        throw error::get_error_code_from_errno(errno);
+    }
+    for (auto *const half : {reserved, reserved + this->cap}) {
+        if (::mmap(half, this->cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)
+                == MAP_FAILED) {
+            const auto err = errno;
+            ::munmap(reserved, this->cap * 2);
+            throw error::get_error_code_from_errno(err);
+        }
+    }
+    //The mappings keep the memfd alive, the descriptor itself is closed on return
+    this->base = reserved;
+}
+
+RingBuffer::~RingBuffer() {
+    if (this->base) {
+        ::munmap(this->base, this->cap * 2);
+    }
+}
+
+RingBuffer::RingBuffer(RingBuffer&& other) noexcept :
+        base{std::exchange(other.base, nullptr)},
+        cap{std::exchange(other.cap, 0)},
+        head{std::exchange(other.head, 0)},
+        count{std::exchange(other.count, 0)} {
+}
+
+RingBuffer& RingBuffer::operator=(RingBuffer&& other) noexcept {
+    if (this != &other) {
+        if (this->base) {
+            ::munmap(this->base, this->cap * 2);
+        }
+        this->base = std::exchange(other.base, nullptr);
+        this->cap = std::exchange(other.cap, 0);
+        this->head = std::exchange(other.head, 0);
+        this->count = std::exchange(other.count, 0);
+    }
+    return *this;
 }
 
 } // namespace n3
@@ -1,15 +1,19 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <concepts>
-#include <deque>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <ranges>
 #include <span>
 #include <sys/uio.h>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -83,12 +87,17 @@ public:
     //Default constructor would mean nullptr which we don't want to allow
     constexpr RefBuffer() = delete;
 
-    //Constructor for anything that can normally make an ::iovec
+    /*
+     * Constructor for anything that can normally make an ::iovec
+     * Constrained so it doesn't hijack copies from non-const lvalues of RefBuffer itself
+     */
     constexpr RefBuffer(auto&&...args) noexcept(
-            std::is_nothrow_constructible_v<decltype(underlying), decltype(args)...>) :
-            underlying{std::forward<decltype(args)>(args)...} {
+            std::is_nothrow_constructible_v<decltype(underlying), decltype(args)...>)
+        requires(std::constructible_from<::iovec, decltype(args)...>
+                        && !(std::same_as<std::remove_cvref_t<decltype(args)>, RefBuffer> || ...))
+            : underlying{std::forward<decltype(args)>(args)...} {
         //Assert that all the types in the parameter pack aren't the null pointer
-        static_assert((std::is_null_pointer_v<decltype(args)> && ...));
+        static_assert((!std::is_null_pointer_v<std::decay_t<decltype(args)>> && ...));
     }
 
     //Constructor for other types of spans that can be converted to a span of bytes
@@ -100,7 +109,7 @@ public:
 
     //Constructor for arbitrary type pointers which can always be cast to void* in an iovec
     template<typename T>
-        requires(std::is_trivially_copyable_v<T> + !std::is_null_pointer_v<T>)
+        requires(std::is_trivially_copyable_v<T> && !std::is_null_pointer_v<T>)
     constexpr RefBuffer(T *const buf) noexcept : underlying{static_cast<void *>(buf), sizeof(T)} {
     }
 
@@ -146,8 +155,32 @@ public:
     }
 };
 
+/*
+ * Consumed buffers at the front are skipped with a head index instead of being erased, so a
+ * consume only touches the buffers it finishes
+ * The vector is compacted lazily once the dead prefix is at least half of it, which keeps
+ * consume amortized O(1) per buffer while the live buffers stay one contiguous iovec array
+ */
 class RefMultiBuffer {
+    //Below this many dead entries, shifting them out isn't worth it
+    static constexpr size_t COMPACT_THRESHOLD = 64;
+
     std::vector<RefBuffer> buffers;
+    size_t head{0};
+
+    constexpr void compact() noexcept {
+        if (this->head == this->buffers.size()) {
+            //Keeps the capacity around for the next batch
+            this->buffers.clear();
+            this->head = 0;
+            return;
+        }
+        if (this->head >= COMPACT_THRESHOLD && this->head * 2 >= this->buffers.size()) {
+            this->buffers.erase(this->buffers.begin(),
+                    this->buffers.begin() + static_cast<std::ptrdiff_t>(this->head));
+            this->head = 0;
+        }
+    }
 
 public:
     //Default constructor
@@ -155,41 +188,55 @@ public:
 
     //Move constructible only
     constexpr RefMultiBuffer(const RefMultiBuffer&) = delete;
-    constexpr RefMultiBuffer(RefMultiBuffer&&) = default;
+    constexpr RefMultiBuffer(RefMultiBuffer&& other) noexcept :
+            buffers{std::move(other.buffers)},
+            head{std::exchange(other.head, 0)} {
+        other.buffers.clear();
+    }
 
     //Constructor for anything that can normally make an std::vector<RefBuffer>
     constexpr RefMultiBuffer(auto&&...args) noexcept(
-            std::is_nothrow_constructible_v<decltype(this->buffers), decltype(args)...>) :
-            buffers{std::forward<decltype(args)>(args)...} {
+            std::is_nothrow_constructible_v<decltype(this->buffers), decltype(args)...>)
+        requires(!(std::same_as<std::remove_cvref_t<decltype(args)>, RefMultiBuffer> || ...))
+            : buffers{std::forward<decltype(args)>(args)...} {
     }
 
     //Move assignable only
     constexpr RefMultiBuffer& operator=(const RefMultiBuffer&) = delete;
-    constexpr RefMultiBuffer& operator=(RefMultiBuffer&&) = default;
+    constexpr RefMultiBuffer& operator=(RefMultiBuffer&& other) noexcept {
+        this->buffers = std::move(other.buffers);
+        this->head = std::exchange(other.head, 0);
+        other.buffers.clear();
+        return *this;
+    }
 
     [[nodiscard]] constexpr auto data() noexcept -> RefBuffer * {
-        return this->buffers.data();
+        return this->buffers.data() + this->head;
     }
     [[nodiscard]] constexpr auto data() const noexcept -> const RefBuffer * {
-        return this->buffers.data();
+        return this->buffers.data() + this->head;
     }
 
     [[nodiscard]] constexpr auto size() const noexcept -> size_t {
-        return this->buffers.size();
+        return this->buffers.size() - this->head;
+    }
+    [[nodiscard]] constexpr auto empty() const noexcept -> bool {
+        return this->size() == 0;
     }
     [[nodiscard]] constexpr auto size_bytes() const noexcept -> size_t {
-        return std::ranges::fold_left(
-                this->buffers | std::views::transform(&RefBuffer::size), 0, std::plus<size_t>());
+        return std::ranges::fold_left(*this | std::views::transform(&RefBuffer::size),
+                size_t{0},
+                std::plus<size_t>());
     }
 
     [[nodiscard]] constexpr auto begin() noexcept -> RefBuffer * {
-        return this->buffers.data();
+        return this->data();
     }
     [[nodiscard]] constexpr auto begin() const noexcept -> const RefBuffer * {
-        return this->buffers.data();
+        return this->data();
     }
     [[nodiscard]] constexpr auto cbegin() const noexcept -> const RefBuffer * {
-        return this->buffers.data();
+        return this->data();
     }
     [[nodiscard]] constexpr auto end() noexcept -> RefBuffer * {
         return this->buffers.data() + this->buffers.size();
@@ -202,37 +249,27 @@ public:
     }
 
     /*
-     * TODO: Implement constructor for pointers and non-const lvalue-references
-     * Would be useful to transparently switch to scatter-gather IO based on usage
-     * Requires some fancy concept constraints to make sure we can make iovecs as expected
-     * For example:
-     *
-     * TcpSocket s{};
-     * s.connect("127.0.0.1", 80);
-     *
-     * int x = 0;
-     * uint32_t y = 0xdeadbeef;
-     * std::string body = "Some longer string of text";
-     *
-     * s.send(x, y, body); //This would call writev et al under the hood
+     * Fixed argument lists don't need a RefMultiBuffer at all, see gather() below
+     * It builds the iovec array on the stack straight from the arguments, which is what
+     * socket::send(sock, x, y, body) uses to turn a header and body into one sendmsg
      */
 
     [[nodiscard]] constexpr RefBuffer& operator[](const size_t idx) noexcept {
-        assert(idx <= buffers.size());
-        return buffers[idx];
+        assert(idx < this->size());
+        return this->buffers[this->head + idx];
     }
     [[nodiscard]] constexpr const RefBuffer& operator[](const size_t idx) const noexcept {
-        assert(idx <= buffers.size());
-        return buffers[idx];
+        assert(idx < this->size());
+        return this->buffers[this->head + idx];
     }
 
     [[nodiscard]] constexpr operator ::iovec *() noexcept {
-        assert(!this->buffers.empty());
-        return reinterpret_cast<::iovec *>(this->buffers.data());
+        assert(!this->empty());
+        return reinterpret_cast<::iovec *>(this->data());
     }
     [[nodiscard]] constexpr operator const ::iovec *() const noexcept {
-        assert(!this->buffers.empty());
-        return reinterpret_cast<const ::iovec *>(this->buffers.data());
+        assert(!this->empty());
+        return reinterpret_cast<const ::iovec *>(this->data());
     }
 
     constexpr void push_back(const RefBuffer& buf) {
@@ -247,40 +284,31 @@ public:
     }
 
     constexpr void extend(const RefMultiBuffer& multi) {
-        std::ranges::copy(multi.buffers, std::back_inserter(this->buffers));
+        this->buffers.insert(this->buffers.end(), multi.begin(), multi.end());
     }
     constexpr void extend(RefMultiBuffer&& multi) {
-        std::ranges::move(multi.buffers, std::back_inserter(this->buffers));
+        this->extend(std::as_const(multi));
     }
 
     constexpr void consume(const size_t bytes) {
         assert(bytes <= this->size_bytes());
 
-        //Remove buffers from the head while the total size is smaller than the requested amount
-        size_t sum = 0;
-        std::erase_if(this->buffers, [&](const auto& buf) {
-            const auto remaining = (bytes - sum);
-            const bool should_erase = (buf.size() <= remaining);
-            sum += (should_erase) ? buf.size() : remaining;
-            return should_erase;
-        });
-        assert(sum <= bytes);
-
-        //Should only happen when bytes is equal to the total number of bytes stored in the buffers
-        if (this->buffers.empty()) {
-            assert(sum == bytes);
-            return;
+        //Only walks the buffers that are finished, plus the one left partially consumed
+        size_t remaining = bytes;
+        while (this->head < this->buffers.size()) {
+            auto& head_buffer = this->buffers[this->head];
+            if (head_buffer.size() > remaining) {
+                if (remaining > 0) {
+                    head_buffer = head_buffer.as_span() | std::views::drop(remaining);
+                    remaining = 0;
+                }
+                break;
+            }
+            remaining -= head_buffer.size();
+            ++this->head;
         }
-
-        const auto remaining = (bytes - sum);
-        assert(remaining > 0);
-
-        auto& head_buffer = this->buffers.front();
-        //Initial buffer size <= remaining should have been handled by the std::erase_if condition
-        assert(head_buffer.size() > remaining);
-
-        //Partial consumption of the remaining head buffer
-        head_buffer = head_buffer.as_span() | std::views::drop(remaining);
+        assert(remaining == 0);
+        this->compact();
     }
 };
 
@@ -288,15 +316,129 @@ static_assert(std::is_nothrow_default_constructible_v<RefMultiBuffer>);
 static_assert(std::is_nothrow_move_constructible_v<RefMultiBuffer>);
 static_assert(std::is_nothrow_move_assignable_v<RefMultiBuffer>);
 
+/*
+ * Anything gather() can point an iovec at without copying
+ * RefBuffers, contiguous ranges of trivially copyable elements (spans, strings, vectors, arrays),
+ * and any other trivially copyable object by its own bytes
+ * Pointers are rejected since sending the pointer value is never what was meant, and so are char
+ * arrays since a string literal would carry its terminator, wrap those in a std::string_view
+ */
+template<typename T>
+concept GatherPart = std::same_as<T, RefBuffer>
+        || (std::ranges::contiguous_range<const T> && std::ranges::sized_range<const T>
+                && std::is_trivially_copyable_v<std::ranges::range_value_t<const T>>
+                && !(std::is_array_v<T> && std::same_as<std::remove_extent_t<T>, const char>)
+                && !(std::is_array_v<T> && std::same_as<std::remove_extent_t<T>, char>))
+        || (std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>
+                && !std::is_member_pointer_v<T> && !std::is_null_pointer_v<T>
+                && !std::is_array_v<T>);
+
+template<GatherPart T>
+[[nodiscard]] constexpr ::iovec gather_part(const T& part) noexcept {
+    //iovec has no const variant, the const_cast is safe as long as the list is only sent from
+    if constexpr (std::same_as<T, RefBuffer>) {
+        return part.as_iovec();
+    } else if constexpr (std::ranges::contiguous_range<const T>) {
+        return {const_cast<void *>(static_cast<const void *>(std::ranges::data(part))),
+                std::ranges::size(part) * sizeof(std::ranges::range_value_t<const T>)};
+    } else {
+        return {const_cast<void *>(static_cast<const void *>(std::addressof(part))), sizeof(T)};
+    }
+}
+
+/*
+ * One iovec per argument, in order, sized from the pack so the whole list lives on the stack
+ * The iovecs point into the arguments, so they have to outlive the syscall the list is used for
+ * Which is always true when the call is made in the same full expression
+ */
+template<GatherPart... Parts>
+[[nodiscard]] constexpr std::array<::iovec, sizeof...(Parts)> gather(
+        const Parts&...parts) noexcept {
+    return {gather_part(parts)...};
+}
+
+/*
+ * Page allocator backed by 2 MiB mmap regions
+ *
+ * Each region is a MAP_HUGETLB mapping when the hugetlb pool has pages to spare, otherwise a
+ * 2 MiB aligned normal mapping with MADV_HUGEPAGE so THP can back it with one huge page
+ * Either way a few thousand scattered I/O pages cost a handful of TLB entries instead of one each
+ *
+ * Pages are handed out from the fullest-first region list so load concentrates and whole regions
+ * go idle, one idle region is kept warm and the rest are given back
+ * Normal regions get MADV_FREE, which leaves the mapping in place and only drops the memory if
+ * the kernel comes under pressure, hugetlb regions don't support it and are unmapped instead
+ */
+class page_arena {
+public:
+    static constexpr size_t REGION_SIZE = 2 * 1024 * 1024;
+
+    enum class backing : uint8_t {
+        hugetlb,
+        transparent,
+    };
+
+private:
+    struct region {
+        //REGION_SIZE aligned, so any page maps back to its region by masking off the low bits
+        std::byte *base;
+        backing kind;
+        //Page indices, LIFO so the most recently freed (cache warm) page goes out next
+        std::vector<uint32_t> free_pages;
+        size_t in_use;
+        //Whole region was handed back with MADV_FREE since it was last used
+        bool released;
+    };
+
+    const size_t page_size;
+    const bool try_hugetlb;
+    std::mutex lock;
+    //Keyed by base address, deallocate() finds a page's region without scanning
+    std::unordered_map<uintptr_t, region> regions;
+
+    [[nodiscard]] region& map_region();
+    void release_idle(region& idle) noexcept;
+
+public:
+    //Falls back to THP regions when hugetlb is disabled or the hugetlb pool is empty
+    explicit page_arena(const bool use_hugetlb = true);
+    ~page_arena();
+
+    page_arena(const page_arena&) = delete;
+    page_arena& operator=(const page_arena&) = delete;
+
+    //Process wide arena used by PageBuffer
+    [[nodiscard]] static page_arena& global();
+
+    //One page, page aligned, throws std::bad_alloc if a new region can't be mapped
+    [[nodiscard]] std::byte *allocate();
+    void deallocate(std::byte *const page) noexcept;
+
+    //Gives every idle region back now instead of keeping one warm
+    void trim() noexcept;
+
+    [[nodiscard]] size_t region_count() noexcept;
+    [[nodiscard]] size_t pages_in_use() noexcept;
+
+    //unique_ptr deleter returning the page to the arena it came from
+    struct page_delete {
+        page_arena *arena;
+        void operator()(std::byte *const page) const noexcept {
+            this->arena->deallocate(page);
+        }
+    };
+};
+
 /*
  * A simple memory page buffer that checks the page size at runtime
+ * Pages come from a page_arena, so they're packed into huge page backed regions
  */
 class PageBuffer {
     const size_t page_size;
-    const std::unique_ptr<std::byte[]> underlying;
+    const std::unique_ptr<std::byte[], page_arena::page_delete> underlying;
 
 public:
-    PageBuffer();
+    explicit PageBuffer(page_arena& arena = page_arena::global());
 
     //TODO: Add operator* and operator-> as aliases for returning a span for usability?
 
@@ -305,11 +447,99 @@ public:
     }
 };
 
+/*
+ * Streaming receive ring buffer with its memory mapped twice back to back
+ *
+ * The same memfd pages sit at [0, capacity) and [capacity, 2 * capacity), so any range of up to
+ * capacity bytes starting inside the first mapping is contiguous, wrapped or not
+ * The buffered data is always a single RefBuffer for parsers, and the free space is always a
+ * single RefBuffer to recv/readv into, nothing ever has to be copied across the wrap point
+ */
+class RingBuffer {
+    std::byte *base;
+    size_t cap;
+    //Offset of the oldest unconsumed byte, always inside the first mapping
+    size_t head;
+    size_t count;
+
+public:
+    //Capacity is rounded up to a whole number of pages, throws error::ErrorCode
+    explicit RingBuffer(const size_t min_capacity);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&& other) noexcept;
+
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer& operator=(RingBuffer&& other) noexcept;
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return this->cap;
+    }
+    [[nodiscard]] size_t size() const noexcept {
+        return this->count;
+    }
+    [[nodiscard]] bool empty() const noexcept {
+        return this->count == 0;
+    }
+    [[nodiscard]] bool full() const noexcept {
+        return this->count == this->cap;
+    }
+
+    //Everything received and not yet consumed
+    [[nodiscard]] RefBuffer readable() const noexcept {
+        return std::span{this->base + this->head, this->count};
+    }
+    //Free space, receive into this and then commit() however much arrived
+    [[nodiscard]] RefBuffer writable() const noexcept {
+        return std::span{this->base + ((this->head + this->count) % this->cap),
+                this->cap - this->count};
+    }
+
+    void commit(const size_t bytes) noexcept {
+        assert(bytes <= this->cap - this->count);
+        this->count += bytes;
+    }
+    void consume(const size_t bytes) noexcept {
+        assert(bytes <= this->count);
+        this->head = (this->head + bytes) % this->cap;
+        this->count -= bytes;
+    }
+};
+
+/*
+ * FIFO of buffers waiting to be written, each push carries a callback for when it's consumed
+ *
+ * Buffers and callbacks share one entry array, with a push's callback on its last buffer, so
+ * consuming walks a single contiguous array and the callback is right there when it finishes
+ * Consumed entries are skipped with a head index and compacted lazily like RefMultiBuffer, so
+ * a partial write only touches the entries it finishes no matter how long the queue is
+ */
 class BufferQueue {
-    RefMultiBuffer buffers;
-    std::deque<std::pair<n3::callback<void>, size_t>> callbacks;
-    size_t buffer_size;
-    size_t buffer_bytes_size;
+    static constexpr size_t COMPACT_THRESHOLD = 64;
+
+    struct entry {
+        RefBuffer buf;
+        //Only set on the last buffer of each push
+        std::optional<n3::callback<void>> on_consumed;
+    };
+
+    std::vector<entry> entries;
+    size_t head{0};
+    size_t buffer_bytes_size{0};
+
+    constexpr void compact() noexcept {
+        if (this->head == this->entries.size()) {
+            this->entries.clear();
+            this->head = 0;
+            return;
+        }
+        if (this->head >= COMPACT_THRESHOLD && this->head * 2 >= this->entries.size()) {
+            this->entries.erase(this->entries.begin(),
+                    this->entries.begin() + static_cast<std::ptrdiff_t>(this->head));
+            this->head = 0;
+        }
+    }
 
 public:
     //Default constructor
@@ -317,66 +547,98 @@ public:
 
     //Move constructible only
     BufferQueue(const BufferQueue&) = delete;
-    BufferQueue(BufferQueue&&) = default;
+    BufferQueue(BufferQueue&& other) noexcept :
+            entries{std::move(other.entries)},
+            head{std::exchange(other.head, 0)},
+            buffer_bytes_size{std::exchange(other.buffer_bytes_size, 0)} {
+        other.entries.clear();
+    }
 
     //Move assignable only
     BufferQueue& operator=(const BufferQueue&) = delete;
-    BufferQueue& operator=(BufferQueue&&) = default;
+    BufferQueue& operator=(BufferQueue&& other) noexcept {
+        this->entries = std::move(other.entries);
+        this->head = std::exchange(other.head, 0);
+        this->buffer_bytes_size = std::exchange(other.buffer_bytes_size, 0);
+        other.entries.clear();
+        return *this;
+    }
 
     [[nodiscard]] constexpr auto empty() const noexcept -> bool {
-        return this->buffer_size == 0;
+        return this->size() == 0;
     }
     [[nodiscard]] constexpr auto size() const noexcept -> size_t {
-        return this->buffer_size;
+        return this->entries.size() - this->head;
     }
-
-    constexpr void push(const RefBuffer buf, n3::callback<void>&& callback) {
-        const auto arg_buf_size_bytes = buf.size();
-
-        this->buffer_size++;
-        this->buffer_bytes_size += arg_buf_size_bytes;
-        this->buffers.push_back(std::move(buf));
-        this->callbacks.emplace_back(std::move(callback), arg_buf_size_bytes);
+    [[nodiscard]] constexpr auto size_bytes() const noexcept -> size_t {
+        return this->buffer_bytes_size;
     }
-    constexpr void push(const RefMultiBuffer multi, n3::callback<void>&& callback) {
-        const auto arg_buf_size = multi.size();
-        const auto arg_buf_size_bytes = multi.size_bytes();
-
-        this->buffer_size += arg_buf_size;
-        this->buffer_bytes_size += arg_buf_size_bytes;
-        this->buffers.extend(std::move(multi));
-        this->callbacks.emplace_back(std::move(callback), arg_buf_size_bytes);
+    //Every queued buffer in order, the head one may already be partially consumed
+    [[nodiscard]] constexpr auto pending() const noexcept {
+        return std::span{this->entries}.subspan(this->head)
+                | std::views::transform(&entry::buf);
     }
-    constexpr void pop(const size_t bytes) {
-        if (this->empty()) {
+    //Unsent part of the oldest buffer, the queue must not be empty
+    [[nodiscard]] constexpr auto front() const noexcept -> RefBuffer {
+        assert(!this->empty());
+        return this->entries[this->head].buf;
+    }
+
+    constexpr void push(const RefBuffer buf, n3::callback<void>&& callback) {
+        this->compact();
+        this->entries.push_back({buf, std::move(callback)});
+        this->buffer_bytes_size += buf.size();
+    }
+    //Templated, RefMultiBuffer is implicitly constructible from a span, which would be ambiguous
+    constexpr void push(
+            const std::same_as<RefMultiBuffer> auto& multi, n3::callback<void>&& callback) {
+        if (multi.empty()) {
+            //Nothing to wait on
+            std::invoke(std::move(callback));
             return;
         }
+        this->compact();
+        this->entries.reserve(this->entries.size() + multi.size());
+        for (size_t i = 0; i + 1 < multi.size(); ++i) {
+            this->entries.push_back({multi[i], std::nullopt});
+        }
+        this->entries.push_back({multi[multi.size() - 1], std::move(callback)});
+        this->buffer_bytes_size += multi.size_bytes();
+    }
+    constexpr void pop(const size_t bytes) {
+        this->pop(bytes, [](n3::callback<void>&& cb) { std::invoke(std::move(cb)); });
+    }
 
-        assert(bytes <= buffer_bytes_size);
-        assert(!this->callbacks.empty());
-
-        this->buffers.consume(bytes);
-        this->buffer_size = this->buffers.size();
+    /*
+     * Same as pop(), but fully consumed callbacks are handed to the sink instead of invoked
+     * For when the memory is still in use after the bytes leave the queue, such as zero-copy
+     * sends, which can only release it once the kernel says it's done with the pages
+     *
+     * Callbacks may push to (or even replace) this queue, so no reference into the entry array
+     * is held across a call to the sink
+     */
+    template<std::invocable<n3::callback<void>&&> Sink>
+    constexpr void pop(const size_t bytes, Sink&& sink) {
+        assert(bytes <= this->buffer_bytes_size);
+        this->buffer_bytes_size -= bytes;
 
         size_t remaining = bytes;
-        while (remaining > 0) {
-            assert(!this->callbacks.empty());
-            auto& [cb, cb_size] = this->callbacks.front();
-            if (cb_size <= remaining) {
-                remaining -= cb_size;
-                std::invoke(std::move(cb));
-                this->callbacks.pop_front();
-                /*
-                 * pop_front() invalidates the .front() references above, so explicitly
-                 * continue here to prevent any accidental further loop logic using them
-                 */
-                continue;
+        while (this->head < this->entries.size()) {
+            auto& head_entry = this->entries[this->head];
+            if (head_entry.buf.size() > remaining) {
+                if (remaining > 0) {
+                    head_entry.buf = head_entry.buf.as_span() | std::views::drop(remaining);
+                }
+                break;
+            }
+            remaining -= head_entry.buf.size();
+            auto cb = std::exchange(head_entry.on_consumed, std::nullopt);
+            ++this->head;
+            if (cb.has_value()) {
+                std::invoke(sink, std::move(*cb));
             }
-            assert(cb_size > remaining);
-            cb_size -= remaining;
-            remaining = 0;
-            break;
         }
+        this->compact();
     }
 };
 
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <expected>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <sys/epoll.h>
@@ -15,4 +16,39 @@
 
 namespace n3 {
 
+#ifdef N3_CALLBACK_DIAGNOSTICS
+namespace {
+//Diagnostic builds only, a plain lock keeps the largest size and its type name consistent
+std::mutex stats_lock;
+callback_capture_stats stats{};
+} // namespace
+
+[[nodiscard]] callback_capture_stats callback_stats() noexcept {
+    const std::lock_guard lock{stats_lock};
+    return stats;
+}
+
+void reset_callback_stats() noexcept {
+    const std::lock_guard lock{stats_lock};
+    stats = {};
+}
+
+namespace detail {
+void record_callback_capture(const size_t bytes, const bool heap, const char *type) noexcept {
+    const std::lock_guard lock{stats_lock};
+    ++stats.created;
+    if (heap) {
+        ++stats.heap;
+        ++stats.by_size.back();
+    } else {
+        ++stats.by_size[(bytes + 7) / 8];
+    }
+    if (bytes > stats.largest) {
+        stats.largest = bytes;
+        stats.largest_type = type;
+    }
+}
+} // namespace detail
+#endif
+
 } // namespace n3
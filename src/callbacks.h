@@ -1,84 +1,238 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
 #include <functional>
-#include <tuple>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+//Inline capture capacity of n3::callback, set through the N3_CALLBACK_INLINE_BYTES cmake option
+#ifndef N3_CALLBACK_INLINE_BYTES
+#define N3_CALLBACK_INLINE_BYTES 48
+#endif
 
 namespace n3 {
 
-//TODO: This is a one-time-only callback, do we want a second potential type for multi-call?
-template<typename... cArgs>
-class callback {
-    std::move_only_function<void(cArgs...)> mf;
+inline constexpr size_t CALLBACK_INLINE_BYTES = N3_CALLBACK_INLINE_BYTES;
 
-public:
-    //TODO: Verify requirements on std::move_only_function to prevent UB (like ensure Func type is constructible)
-    template<typename F, typename... fArgs>
-    constexpr callback(F&& func, fArgs&&...func_args) :
-            mf{std::bind_front(std::forward<F>(func), std::forward<fArgs>(func_args)...)} {
-    }
-    template<typename F>
-    constexpr callback(F&& func) : mf{std::forward<F>(func)} {
-    }
+//Tag to opt a single callback into heap storage when its capture can't fit inline
+struct heap_allocate_t {
+    explicit heap_allocate_t() = default;
+};
+inline constexpr heap_allocate_t heap_allocate{};
 
-    callback(const callback&) noexcept = delete;
-    callback(callback&&) noexcept = default;
+#ifdef N3_CALLBACK_DIAGNOSTICS
+/*
+ * Capture sizes of every callback constructed since the last reset
+ * Sizes are bucketed in 8 byte steps up to the inline capacity, the last bucket is heap storage
+ */
+struct callback_capture_stats {
+    size_t created;
+    size_t heap;
+    size_t largest;
+    //typeid name of the largest capture, mangled
+    const char *largest_type;
+    std::array<size_t, CALLBACK_INLINE_BYTES / 8 + 2> by_size;
+};
 
-    callback& operator=(const callback&) noexcept = delete;
-    callback& operator=(callback&&) noexcept = default;
+[[nodiscard]] callback_capture_stats callback_stats() noexcept;
+void reset_callback_stats() noexcept;
 
-    /*
-     * The && at the end signifies that this is only callable by rvalue references of *this
-     * It's a way to specify overload resolution based on reference type
-     * And with it added explicitly, that means the lvalue reference call doesn't exist, so we get
-     * a compile time error if the user doesn't std::move() the object when calling the callback
-     */
-    constexpr void operator()(cArgs&&...call_args) && noexcept(
-            std::is_nothrow_invocable_v<decltype(std::move(this->mf)),
-                    decltype(std::forward<cArgs>(call_args))...>) {
-        std::invoke(std::move(this->mf), std::forward<cArgs>(call_args)...);
-        //TODO: Would like to do something like empty out the function after usage by setting nullptr
-        //Problem is, calling operator() on an empty std::move_only_function is UB, so I'd have to throw something myself
-    }
-};
+namespace detail {
+void record_callback_capture(const size_t bytes, const bool heap, const char *type) noexcept;
+} // namespace detail
+#endif
 
 /*
- * Specialization for no call args since you can't do std::conditional_t<std::void_t, args...>
- * to get void(void) to work due to syntax vs compile-time-evaluation ordering
- * func<void(void)> is not the same as func<void(std::void_t<void>)> despite the fact that both
- * condense down to an argument of "void" at compile time
+ * Move-only, one-shot callable with a guaranteed inline capture buffer
+ * std::move_only_function leaves its small buffer size up to the standard library, and every
+ * write pushes one of these, so a capture that doesn't fit is a compile error here instead of a
+ * silent allocation
+ * Captures that legitimately need more room go through the heap_allocate constructors, which
+ * box the callable and keep only the pointer inline
  */
-template<>
-class callback<void> {
-    std::move_only_function<void()> mf;
+template<size_t Capacity, typename Signature>
+class inline_callback;
+
+template<size_t Capacity, typename... cArgs>
+class inline_callback<Capacity, void(cArgs...)> {
+    template<typename F>
+    static constexpr bool fits_inline = sizeof(F) <= Capacity
+            && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<F>;
+
+    //Spelled out as a template so the offending size shows up in the error's instantiation notes
+    template<size_t Size, size_t Limit>
+    static constexpr bool capture_fits = Size <= Limit;
+
+    struct vtable {
+        //Invokes the callable, then destroys it even if it throws
+        void (*invoke)(void *storage, cArgs&&...args);
+        //Move constructs into dest and destroys the source
+        void (*relocate)(void *dest, void *src) noexcept;
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template<typename F>
+    static constexpr vtable ops_for{
+            .invoke =
+                    [](void *storage, cArgs&&...args) {
+                        auto *const func = std::launder(static_cast<F *>(storage));
+                        struct guard {
+                            F *func;
+                            ~guard() {
+                                std::destroy_at(func);
+                            }
+                        } destroy_after{func};
+                        std::invoke(std::move(*func), std::forward<cArgs>(args)...);
+                    },
+            .relocate =
+                    [](void *dest, void *src) noexcept {
+                        auto *const func = std::launder(static_cast<F *>(src));
+                        std::construct_at(static_cast<F *>(dest), std::move(*func));
+                        std::destroy_at(func);
+                    },
+            .destroy =
+                    [](void *storage) noexcept {
+                        std::destroy_at(std::launder(static_cast<F *>(storage)));
+                    },
+    };
+
+    //Heap fallback, only the owning pointer lives in the inline buffer
+    template<typename F>
+    struct boxed {
+        std::unique_ptr<F> func;
+
+        void operator()(cArgs&&...args) {
+            std::invoke(std::move(*this->func), std::forward<cArgs>(args)...);
+        }
+    };
+
+    alignas(std::max_align_t) std::byte storage[Capacity];
+    const vtable *ops{nullptr};
+
+    template<typename F>
+    void emplace(F&& func) {
+        using stored = std::decay_t<F>;
+        static_assert(std::is_invocable_v<stored&&, cArgs&&...>,
+                "Callback is not invocable with the callback arguments");
+        static_assert(capture_fits<sizeof(stored), Capacity>,
+                "Callback capture exceeds the inline capacity, shrink the capture, raise "
+                "N3_CALLBACK_INLINE_BYTES, or construct with n3::heap_allocate");
+        static_assert(fits_inline<stored>,
+                "Callback capture must be nothrow movable and at most max_align_t aligned to "
+                "live inline, construct with n3::heap_allocate instead");
+#ifdef N3_CALLBACK_DIAGNOSTICS
+        detail::record_callback_capture(sizeof(stored), false, typeid(stored).name());
+#endif
+        std::construct_at(reinterpret_cast<stored *>(this->storage), std::forward<F>(func));
+        this->ops = &ops_for<stored>;
+    }
+
+    template<typename F>
+    void emplace_boxed(F&& func) {
+        using stored = std::decay_t<F>;
+#ifdef N3_CALLBACK_DIAGNOSTICS
+        detail::record_callback_capture(sizeof(stored), true, typeid(stored).name());
+#endif
+        std::construct_at(reinterpret_cast<boxed<stored> *>(this->storage),
+                std::make_unique<stored>(std::forward<F>(func)));
+        this->ops = &ops_for<boxed<stored>>;
+    }
+
+    void reset() noexcept {
+        if (this->ops) {
+            std::exchange(this->ops, nullptr)->destroy(this->storage);
+        }
+    }
 
 public:
-    //TODO: Verify requirements on std::move_only_function to prevent UB (like ensure Func type is constructible)
     template<typename F, typename... fArgs>
-    constexpr callback(F&& func, fArgs&&...func_args) :
-            mf{std::bind_front(std::forward<F>(func), std::forward<fArgs>(func_args)...)} {
+        requires(!std::same_as<std::remove_cvref_t<F>, inline_callback>
+                 && !std::same_as<std::remove_cvref_t<F>, heap_allocate_t>)
+    inline_callback(F&& func, fArgs&&...func_args) {
+        this->emplace(std::bind_front(std::forward<F>(func), std::forward<fArgs>(func_args)...));
     }
     template<typename F>
-    constexpr callback(F&& func) : mf{std::forward<F>(func)} {
+        requires(!std::same_as<std::remove_cvref_t<F>, inline_callback>
+                 && !std::same_as<std::remove_cvref_t<F>, heap_allocate_t>)
+    inline_callback(F&& func) {
+        this->emplace(std::forward<F>(func));
     }
 
-    callback(const callback&) noexcept = delete;
-    callback(callback&&) noexcept = default;
+    template<typename F, typename... fArgs>
+    inline_callback(heap_allocate_t, F&& func, fArgs&&...func_args) {
+        this->emplace_boxed(
+                std::bind_front(std::forward<F>(func), std::forward<fArgs>(func_args)...));
+    }
+    template<typename F>
+    inline_callback(heap_allocate_t, F&& func) {
+        this->emplace_boxed(std::forward<F>(func));
+    }
 
-    callback& operator=(const callback&) noexcept = delete;
-    callback& operator=(callback&&) noexcept = default;
+    inline_callback(const inline_callback&) noexcept = delete;
+    inline_callback(inline_callback&& other) noexcept : ops{std::exchange(other.ops, nullptr)} {
+        if (this->ops) {
+            this->ops->relocate(this->storage, other.storage);
+        }
+    }
+
+    inline_callback& operator=(const inline_callback&) noexcept = delete;
+    inline_callback& operator=(inline_callback&& other) noexcept {
+        if (this != std::addressof(other)) {
+            this->reset();
+            this->ops = std::exchange(other.ops, nullptr);
+            if (this->ops) {
+                this->ops->relocate(this->storage, other.storage);
+            }
+        }
+        return *this;
+    }
+
+    ~inline_callback() {
+        this->reset();
+    }
 
     /*
      * The && at the end signifies that this is only callable by rvalue references of *this
      * It's a way to specify overload resolution based on reference type
      * And with it added explicitly, that means the lvalue reference call doesn't exist, so we get
      * a compile time error if the user doesn't std::move() the object when calling the callback
+     * The callable is destroyed once it returns, so calling twice asserts instead of being UB
      */
-    constexpr void operator()() && noexcept(
-            std::is_nothrow_invocable_v<decltype(std::move(this->mf))>) {
-        std::invoke(std::move(this->mf));
-        //TODO: Would like to do something like empty out the function after usage by setting nullptr
-        //Problem is, calling operator() on an empty std::move_only_function is UB, so I'd have to throw something myself
+    void operator()(cArgs&&...call_args) && {
+        assert(this->ops);
+        std::exchange(this->ops, nullptr)
+                ->invoke(this->storage, std::forward<cArgs>(call_args)...);
     }
 };
 
+namespace detail {
+/*
+ * Maps the callback argument list to a function signature
+ * Needed since you can't do std::conditional_t<std::void_t, args...> to get void(void) to work
+ * due to syntax vs compile-time-evaluation ordering
+ * func<void(void)> is not the same as func<void(std::void_t<void>)> despite the fact that both
+ * condense down to an argument of "void" at compile time
+ */
+template<typename... cArgs>
+struct callback_signature {
+    using type = void(cArgs...);
+};
+template<>
+struct callback_signature<void> {
+    using type = void();
+};
+} // namespace detail
+
+//TODO: This is a one-time-only callback, do we want a second potential type for multi-call?
+template<typename... cArgs>
+using callback = inline_callback<CALLBACK_INLINE_BYTES,
+        typename detail::callback_signature<cArgs...>::type>;
+
 } // namespace n3
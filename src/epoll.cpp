@@ -6,6 +6,7 @@
 #include <optional>
 #include <span>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <system_error>
 #include <unistd.h>
 #include <utility>
@@ -18,6 +19,22 @@
 
 namespace n3::linux::epoll {
 
+namespace {
+
+    //Layout of the uapi struct epoll_params, declared here since <linux/eventpoll.h> clashes with
+    //<sys/epoll.h> and older headers don't have it at all
+    struct kernel_epoll_params {
+        uint32_t busy_poll_usecs;
+        uint16_t busy_poll_budget;
+        uint8_t prefer_busy_poll;
+        uint8_t pad;
+    };
+    static_assert(sizeof(kernel_epoll_params) == 8);
+
+    constexpr unsigned long EPOLL_SET_PARAMS = _IOW(0x8A, 0x01, kernel_epoll_params);
+
+} // namespace
+
 epoll_handle::epoll_handle() : efd(epoll_create1(EPOLL_CLOEXEC)) {
     if (this->efd == -1) {
         throw error::get_error_code_from_errno(errno);
@@ -32,12 +49,12 @@ epoll_handle::~epoll_handle() noexcept {
 epoll_ctx::epoll_ctx() : efd{}, events{} {
 }
 
-[[nodiscard]] auto epoll_ctx::add(Handle fd) noexcept
+[[nodiscard]] auto epoll_ctx::add(Handle fd, const uint64_t token) noexcept
         -> const std::expected<void, error::ErrorCode> {
     static constexpr auto EVENT_MASK = (EPOLLIN | EPOLLOUT | EPOLLET | EPOLLEXCLUSIVE);
     ::epoll_event event{
             .events = EVENT_MASK,
-            .data{.ptr = this},
+            .data{.u64 = token},
     };
 
     const auto ret = epoll_ctl(this->efd.efd, EPOLL_CTL_ADD, fd, &event);
@@ -56,11 +73,26 @@ epoll_ctx::epoll_ctx() : efd{}, events{} {
     return {};
 }
 
+[[nodiscard]] auto epoll_ctx::set_busy_poll(const busy_poll_params& params) noexcept
+        -> const std::expected<void, error::ErrorCode> {
+    kernel_epoll_params raw{
+            .busy_poll_usecs = static_cast<uint32_t>(params.busy_poll.count()),
+            .busy_poll_budget = params.budget,
+            .prefer_busy_poll = static_cast<uint8_t>(params.prefer_busy_poll),
+            .pad = 0,
+    };
+    const auto ret = ::ioctl(this->efd.efd, EPOLL_SET_PARAMS, &raw);
+    if (ret == -1) {
+        return std::unexpected(error::get_error_code_from_errno(errno));
+    }
+    return {};
+}
+
 [[nodiscard]] auto epoll_ctx::wait(
         const std::optional<const std::chrono::milliseconds>& timeout_ms) noexcept
         -> const std::expected<const std::span<const ::epoll_event>, error::ErrorCode> {
-    //Zero will block forever if the timeout optional is empty
-    const int epoll_timeout = timeout_ms.value_or(std::chrono::milliseconds{0}).count();
+    //Negative values block forever, which is what an empty timeout optional means
+    const int epoll_timeout = timeout_ms.value_or(std::chrono::milliseconds{-1}).count();
     const auto ret
             = epoll_wait(this->efd.efd, this->events.data(), this->events.size(), epoll_timeout);
     if (ret == -1) {
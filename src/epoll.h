@@ -2,6 +2,7 @@
 
 #include <array>
 #include <chrono>
+#include <cstdint>
 #include <expected>
 #include <memory>
 #include <optional>
@@ -27,6 +28,14 @@ public:
     ~epoll_handle() noexcept;
 };
 
+//Mirrors the kernel's struct epoll_params (6.9+), busy polls the NAPI contexts of every socket
+struct busy_poll_params {
+    std::chrono::microseconds busy_poll{0};
+    //Packets per NAPI poll, above 64 (NAPI_POLL_WEIGHT) needs CAP_NET_ADMIN
+    uint16_t budget{0};
+    bool prefer_busy_poll{false};
+};
+
 class epoll_ctx {
     static constexpr size_t EVENT_BUFFER_SIZE = 32768;
 
@@ -41,9 +50,14 @@ public:
     epoll_ctx& operator=(const epoll_ctx&) noexcept = default;
     epoll_ctx& operator=(epoll_ctx&&) noexcept = default;
 
-    [[nodiscard]] auto add(const Handle fd) noexcept -> const std::expected<void, error::ErrorCode>;
+    //The token is handed back untouched in epoll_event.data.u64 for every event on the fd
+    [[nodiscard]] auto add(const Handle fd, const uint64_t token) noexcept
+            -> const std::expected<void, error::ErrorCode>;
     [[nodiscard]] auto remove(const Handle fd) noexcept
             -> const std::expected<void, error::ErrorCode>;
+    //EPIOCSPARAMS, fails with ENOTTY on kernels that predate per-epoll busy polling
+    [[nodiscard]] auto set_busy_poll(const busy_poll_params& params) noexcept
+            -> const std::expected<void, error::ErrorCode>;
     [[nodiscard]] auto wait(const std::optional<const std::chrono::milliseconds>& timeout_ms
             = std::nullopt) noexcept
             -> const std::expected<const std::span<const ::epoll_event>, error::ErrorCode>;
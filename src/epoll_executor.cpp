@@ -1,29 +1,596 @@
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "epoll_executor.h"
 
 #include "epoll.h"
 #include "error.h"
 #include "handle.h"
+#include "syscalls.h"
 
 namespace n3::linux::epoll {
 
-epoll_executor::epoll_executor() : epoll{} {
+namespace {
+
+    /*
+     * Figure out which error to hand to the head waiter of a handle that raised an error event
+     * SO_ERROR holds the real reason for EPOLLERR, while a plain hangup has no pending error
+     */
+    [[nodiscard]] error::ErrorCode pending_error(
+            const Handle fd, const struct events event_flags) noexcept {
+        int so_error = 0;
+        const auto ret = n3::linux::getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error);
+        if (ret.has_value() && so_error != 0) {
+            return error::get_error_code_from_errno(so_error);
+        }
+        if (event_flags.hup || event_flags.rdhup) {
+            return error::get_error_code_from_errno(ECONNRESET);
+        }
+        return error::get_error_code_from_errno(EIO);
+    }
+
+    /*
+     * Per-socket busy polling for kernels without EPIOCSPARAMS
+     * Failures are ignored, the fd might not be a socket (eventfd, pipe) and raising SO_BUSY_POLL
+     * above net.core.busy_read needs CAP_NET_ADMIN
+     */
+    void set_socket_busy_poll(const Handle fd, const latency_config& config) noexcept {
+        int usecs = static_cast<int>(config.busy_poll.count());
+        int prefer = config.prefer_busy_poll ? 1 : 0;
+        int budget = config.busy_poll_budget;
+        [[maybe_unused]] const auto r1
+                = n3::linux::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs);
+        [[maybe_unused]] const auto r2
+                = n3::linux::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer);
+        [[maybe_unused]] const auto r3
+                = n3::linux::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget);
+    }
+
+} // namespace
+
+[[nodiscard]] bool EpollAwaitable::await_ready() noexcept {
+    if (!this->state) {
+        this->result = std::unexpected(error::get_error_code_from_errno(EBADF));
+        return true;
+    }
+    //Claim readiness that arrived before anyone was waiting on it, edge triggered won't repeat it
+    auto& cache = this->state->event_cache;
+    if (this->direction == interest::read && cache.in) {
+        cache.in = false;
+        return true;
+    }
+    if (this->direction == interest::write && cache.out) {
+        cache.out = false;
+        return true;
+    }
+    return false;
+}
+
+void EpollAwaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+    this->waiter = h;
+    if (this->direction == interest::read) {
+        this->state->read_waiters.push(this);
+    } else {
+        this->state->write_waiters.push(this);
+    }
+}
+
+[[nodiscard]] epoll_handle_state& handle_table::acquire(const Handle fd) {
+    assert(fd >= 0);
+    const auto idx = static_cast<size_t>(fd);
+    const auto chunk_idx = idx / CHUNK_SIZE;
+    if (chunk_idx >= this->chunks.size()) {
+        this->chunks.resize(chunk_idx + 1);
+    }
+    auto& chunk_ptr = this->chunks[chunk_idx];
+    if (!chunk_ptr) {
+        chunk_ptr = std::make_unique<chunk>();
+    }
+    auto& slot = (*chunk_ptr)[idx % CHUNK_SIZE];
+    assert(slot.fd < 0);
+    slot.fd = fd;
+    ++this->active;
+    return slot;
+}
+
+//release() rebuilds the slot in place, which must stay allocation free for remove() to be noexcept
+static_assert(std::is_nothrow_default_constructible_v<epoll_handle_state>
+        && std::is_nothrow_move_assignable_v<epoll_handle_state>);
+
+void handle_table::release(epoll_handle_state& slot) noexcept {
+    const auto next_generation = static_cast<uint16_t>(slot.generation + 1);
+    slot = epoll_handle_state{};
+    slot.generation = next_generation;
+    --this->active;
+}
+
+recv_buffer_pool::recv_buffer_pool(const uint32_t buffer_count, const size_t buf_size) :
+        storage{std::make_unique_for_overwrite<std::byte[]>(buffer_count * buf_size)},
+        free_ids{},
+        buffer_size{buf_size} {
+    this->free_ids.reserve(buffer_count);
+    //Reversed so the first borrow hands out buffer 0
+    for (uint32_t id = buffer_count; id > 0; --id) {
+        this->free_ids.push_back(id - 1);
+    }
+}
+
+[[nodiscard]] bool pooled_recv_awaitable::await_ready() noexcept {
+    //Readiness an earlier recv couldn't use, only worth claiming once there's a buffer for it
+    auto *const state = this->readiness.state;
+    if (state && state->rx_starved && this->pool->available() > 0) {
+        state->rx_starved = false;
+        state->event_cache.in = true;
+    }
+    if (!this->readiness.await_ready()) {
+        return false;
+    }
+    if (!this->readiness.result.has_value()) {
+        this->result = std::unexpected(this->readiness.result.error());
+        return true;
+    }
+    //Readiness was cached, but it may be stale, park if there turns out to be nothing to read
+    auto ret = this->attempt();
+    if (!ret.has_value() && ret.error() == error::posix_error{EAGAIN}) {
+        return false;
+    }
+    this->result = std::move(ret);
+    return true;
+}
+
+[[nodiscard]] std::expected<pooled_buffer, error::ErrorCode>
+        pooled_recv_awaitable::await_resume() noexcept {
+    if (this->result.has_value()) {
+        return std::move(*this->result);
+    }
+    if (!this->readiness.result.has_value()) {
+        return std::unexpected(this->readiness.result.error());
+    }
+    return this->attempt();
+}
+
+[[nodiscard]] std::expected<pooled_buffer, error::ErrorCode>
+        pooled_recv_awaitable::attempt() noexcept {
+    auto *const state = this->readiness.state;
+    if (state->fd < 0 || state->generation != this->generation) {
+        return std::unexpected(error::get_error_code_from_errno(EBADF));
+    }
+
+    const auto id = this->pool->borrow();
+    if (!id.has_value()) {
+        //Edge triggered, so the readiness is kept, but not cached or the next recv would spin
+        state->rx_starved = true;
+        return std::unexpected(error::get_error_code_from_errno(ENOBUFS));
+    }
+    const auto buf = this->pool->buffer(*id);
+    const auto ret = n3::linux::recv(state->fd, buf, this->flags | MSG_DONTWAIT);
+    if (!ret.has_value() || *ret == 0) {
+        this->pool->recycle(*id);
+        if (!ret.has_value()) {
+            return std::unexpected(ret.error());
+        }
+        //EOF stays readable, the next attempt sees it again without waiting
+        state->event_cache.in = true;
+        return pooled_buffer{};
+    }
+    if (*ret == buf.size()) {
+        //Filled the buffer, there may be more queued that no new edge will announce
+        state->event_cache.in = true;
+    }
+    return pooled_buffer{*this->pool, *id, *ret};
+}
+
+[[nodiscard]] BufferQueue& queue_slab::acquire() {
+    if (!this->free_list) {
+        auto& fresh = *this->chunks.emplace_back(std::make_unique<chunk>());
+        //Threaded in reverse so the chunk is handed out front to back
+        for (auto it = fresh.rbegin(); it != fresh.rend(); ++it) {
+            it->next_free = std::exchange(this->free_list, &*it);
+        }
+    }
+    auto *const slot = std::exchange(this->free_list, this->free_list->next_free);
+    std::construct_at(&slot->queue);
+    slot->live = true;
+    ++this->in_use;
+    return slot->queue;
+}
+
+void queue_slab::release(BufferQueue& queue) noexcept {
+    assert(queue.empty());
+    //The queue is the first member of the node's union, so the addresses are interconvertible
+    static_assert(std::is_standard_layout_v<node>);
+    auto *const slot = reinterpret_cast<node *>(&queue);
+    assert(slot->live);
+    std::destroy_at(&slot->queue);
+    slot->live = false;
+    slot->next_free = std::exchange(this->free_list, slot);
+    --this->in_use;
+}
+
+epoll_executor::epoll_executor() :
+        epoll{},
+        active{true},
+        wakeup_fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+        handles{},
+        latency{},
+        busy_poll{busy_poll_mode::none},
+        dirty{},
+        flushing{},
+        flush_iovecs{},
+        flush_scratch{},
+        tx_failure{},
+        pending_sends{},
+        free_pending_sends{nullptr},
+        tx_queues{} {
+    if (this->wakeup_fd < 0) {
+        throw error::get_error_code_from_errno(errno);
+    }
+    //Null token so dispatch can tell it apart from every real handle slot
+    this->epoll.add(this->wakeup_fd, 0).value();
 }
 
 [[nodiscard]] auto epoll_executor::add(Handle fd) noexcept
         -> const std::expected<void, error::ErrorCode> {
-    return this->epoll.add(fd);
+    if (this->handles.find(fd)) {
+        return std::unexpected(error::get_error_code_from_errno(EEXIST));
+    }
+    epoll_handle_state *slot = nullptr;
+    try {
+        this->reserve_dirty(this->handles.size() + 1);
+        slot = &this->handles.acquire(fd);
+    } catch (const std::bad_alloc&) {
+        return std::unexpected(error::get_error_code_from_errno(ENOMEM));
+    }
+
+    const epoll_token token{.slot = slot, .generation = slot->generation};
+    const auto ret = this->epoll.add(fd, token.pack());
+    if (!ret.has_value()) {
+        this->handles.release(*slot);
+        return ret;
+    }
+    if (this->busy_poll == busy_poll_mode::per_socket) {
+        set_socket_busy_poll(fd, *this->latency);
+    }
+    return ret;
+}
+
+busy_poll_mode epoll_executor::enable_latency_mode(const latency_config& config) noexcept {
+    this->latency = config;
+
+    const busy_poll_params params{
+            .busy_poll = config.busy_poll,
+            .budget = config.busy_poll_budget,
+            .prefer_busy_poll = config.prefer_busy_poll,
+    };
+    if (this->epoll.set_busy_poll(params).has_value()) {
+        this->busy_poll = busy_poll_mode::epoll;
+    } else {
+        //Pre 6.9 kernels, fall back to the per-socket options from add()
+        this->busy_poll = busy_poll_mode::per_socket;
+    }
+    return this->busy_poll;
 }
 
 [[nodiscard]] auto epoll_executor::remove(Handle fd) noexcept
         -> const std::expected<void, error::ErrorCode> {
-    return this->epoll.remove(fd);
+    const auto ret = this->epoll.remove(fd);
+
+    auto *const slot = this->handles.find(fd);
+    if (!slot) {
+        return ret;
+    }
+    //Detach everything first, the state is gone before any parked coroutine gets to run again
+    auto readers = slot->read_waiters.take_all();
+    auto writers = slot->write_waiters.take_all();
+    //A send callback removed its own handle mid pop, the flush fails the rest once the pop returns
+    auto *const unsent = slot->tx_flushing ? nullptr : slot->tx_queue;
+    this->handles.release(*slot);
+
+    const auto cancelled = std::unexpected(error::get_error_code_from_errno(ECANCELED));
+    readers.complete_all(cancelled);
+    writers.complete_all(cancelled);
+    if (unsent) {
+        this->fail_tx(*unsent, cancelled.error());
+        this->tx_queues.release(*unsent);
+    }
+    return ret;
+}
+
+[[nodiscard]] auto epoll_executor::readable(Handle fd) noexcept -> EpollAwaitable {
+    return {
+            .state = this->handles.find(fd),
+            .direction = interest::read,
+    };
+}
+
+[[nodiscard]] auto epoll_executor::writable(Handle fd) noexcept -> EpollAwaitable {
+    return {
+            .state = this->handles.find(fd),
+            .direction = interest::write,
+    };
+}
+
+[[nodiscard]] auto epoll_executor::recv(Handle fd, recv_buffer_pool& pool, const int flags) noexcept
+        -> pooled_recv_awaitable {
+    auto *const state = this->handles.find(fd);
+    return {
+            .readiness = {.state = state, .direction = interest::read},
+            .generation = state ? state->generation : uint16_t{0},
+            .pool = &pool,
+            .flags = flags,
+    };
+}
+
+void epoll_executor::send(Handle fd,
+        const RefBuffer buf,
+        n3::callback<std::expected<size_t, error::ErrorCode>>&& cb) {
+    auto *const state = this->handles.find(fd);
+    if (!state) {
+        std::move(cb)(std::unexpected(error::get_error_code_from_errno(EBADF)));
+        return;
+    }
+    if (!state->tx_queue) {
+        state->tx_queue = &this->tx_queues.acquire();
+    }
+    auto& op = this->acquire_pending_send(std::move(cb), buf.size());
+    try {
+        state->tx_queue->push(buf, [this, &op] { this->complete_send(op); });
+    } catch (...) {
+        //Nothing was queued, hand the op back without running the callback
+        op.cb.reset();
+        op.next_free = std::exchange(this->free_pending_sends, &op);
+        throw;
+    }
+    this->mark_dirty(*state);
+}
+
+[[nodiscard]] auto epoll_executor::flush(Handle fd) noexcept
+        -> const std::expected<void, error::ErrorCode> {
+    auto *const state = this->handles.find(fd);
+    if (!state || !state->tx_queue) {
+        return {};
+    }
+    const auto still_queued = std::unexpected(error::get_error_code_from_errno(EAGAIN));
+    if (state->tx_flushing) {
+        //Bytes the running flush already popped are in the socket, only the rest can be overtaken
+        if (state->tx_queue->size_bytes() > 0) {
+            return still_queued;
+        }
+        return {};
+    }
+    const auto generation = state->generation;
+    //Still waiting on EPOLLOUT, trying again now would only hit EAGAIN
+    if (!state->tx_blocked) {
+        this->flush(*state);
+    }
+    //A send callback may have removed the handle, which fails (and so empties) its queue
+    if (state->generation == generation && state->tx_queue) {
+        return still_queued;
+    }
+    return {};
+}
+
+[[nodiscard]] epoll_executor::pending_send& epoll_executor::acquire_pending_send(
+        result_callback&& cb, const size_t size) {
+    pending_send *op = this->free_pending_sends;
+    if (op) {
+        this->free_pending_sends = op->next_free;
+    } else {
+        op = &this->pending_sends.emplace_back();
+    }
+    op->cb.emplace(std::move(cb));
+    op->size = size;
+    op->next_free = nullptr;
+    return *op;
+}
+
+void epoll_executor::complete_send(pending_send& op) {
+    //Released before running, the callback may send again and reuse this entry
+    auto cb = std::move(*op.cb);
+    const auto size = op.size;
+    op.cb.reset();
+    op.next_free = std::exchange(this->free_pending_sends, &op);
+
+    if (this->tx_failure.has_value()) {
+        std::move(cb)(std::unexpected(*this->tx_failure));
+        return;
+    }
+    std::move(cb)(size);
+}
+
+/*
+ * Each live handle sits in a list at most once, but removed handles leave stale tokens behind
+ * until the next flush, so dirty gets room for every live handle on top of what it already holds
+ * flushing becomes the next dirty list once it's drained, so it only needs the live handles
+ * Growth is geometric, otherwise every add() would reallocate
+ */
+void epoll_executor::reserve_dirty(const size_t handle_count) {
+    const auto grow = [](std::vector<epoll_token>& list, const size_t needed) {
+        if (list.capacity() < needed) {
+            list.reserve(std::max(needed, list.capacity() * 2));
+        }
+    };
+    grow(this->dirty, this->dirty.size() + handle_count);
+    grow(this->flushing, handle_count);
+}
+
+void epoll_executor::mark_dirty(epoll_handle_state& state) noexcept {
+    if (state.tx_dirty || state.tx_blocked) {
+        return;
+    }
+    //Never reallocates, add() reserved a place for this handle
+    assert(this->dirty.size() < this->dirty.capacity());
+    this->dirty.push_back({.slot = &state, .generation = state.generation});
+    state.tx_dirty = true;
+}
+
+void epoll_executor::fail_tx(BufferQueue& queue, const error::ErrorCode err) noexcept {
+    //Saved and restored, a callback in here may remove another handle and fail its queue too
+    auto previous = std::exchange(this->tx_failure, err);
+    queue.pop(queue.size_bytes());
+    this->tx_failure = std::move(previous);
+}
+
+void epoll_executor::flush_dirty() noexcept {
+    //Swapped out first, callbacks invoked by a flush may dirty handles for the next iteration
+    std::swap(this->dirty, this->flushing);
+    //Indexed, an add() from a callback may grow flushing under the loop
+    for (size_t i = 0; i < this->flushing.size(); ++i) {
+        const auto token = this->flushing[i];
+        //Handle was removed (and maybe reused) since it was queued
+        if (token.is_stale()) {
+            continue;
+        }
+        token.slot->tx_dirty = false;
+        this->flush(*token.slot);
+    }
+    this->flushing.clear();
+}
+
+void epoll_executor::flush(epoll_handle_state& state) noexcept {
+    //Already flushing further up the stack, that flush picks up anything queued since
+    if (!state.tx_queue || state.tx_flushing) {
+        return;
+    }
+    auto& queue = *state.tx_queue;
+    const auto generation = state.generation;
+
+    state.tx_flushing = true;
+    this->write_tx(state, queue);
+    this->return_tx(state, queue, generation);
+}
+
+void epoll_executor::return_tx(
+        epoll_handle_state& state, BufferQueue& queue, const uint16_t generation) noexcept {
+    if (state.generation != generation) {
+        //Removed by one of its own callbacks, whatever the pop didn't reach is cancelled
+        this->fail_tx(queue, error::get_error_code_from_errno(ECANCELED));
+        this->tx_queues.release(queue);
+        return;
+    }
+    state.tx_flushing = false;
+    if (queue.empty()) {
+        state.tx_queue = nullptr;
+        this->tx_queues.release(queue);
+    }
+}
+
+void epoll_executor::write_tx(epoll_handle_state& state, BufferQueue& queue) noexcept {
+    const auto generation = state.generation;
+
+    //Only loops when the queue didn't fit in one call (IOV_MAX or scratch space ran out)
+    while (!queue.empty()) {
+        //One iovec array for the whole queue, runs of small buffers merge into the scratch area
+        size_t count = 0;
+        size_t scratch_used = 0;
+        size_t total = 0;
+        bool last_in_scratch = false;
+        for (const auto& buf : queue.pending()) {
+            const auto size = buf.size();
+            const bool small = (size <= SMALL_WRITE && scratch_used + size <= SCRATCH_SIZE);
+            if (!(small && last_in_scratch) && count == this->flush_iovecs.size()) {
+                break;
+            }
+            if (small) {
+                auto *const dest = this->flush_scratch.data() + scratch_used;
+                std::ranges::copy(buf.as_span(), dest);
+                if (last_in_scratch) {
+                    this->flush_iovecs[count - 1].iov_len += size;
+                } else {
+                    this->flush_iovecs[count++] = {.iov_base = dest, .iov_len = size};
+                }
+                scratch_used += size;
+            } else {
+                this->flush_iovecs[count++] = {.iov_base = buf.data(), .iov_len = size};
+            }
+            total += size;
+            last_in_scratch = small;
+        }
+
+        const ::msghdr msg{
+                .msg_name = nullptr,
+                .msg_namelen = 0,
+                .msg_iov = this->flush_iovecs.data(),
+                .msg_iovlen = count,
+                .msg_control = nullptr,
+                .msg_controllen = 0,
+                .msg_flags = 0,
+        };
+        const auto ret = n3::linux::sendmsg(state.fd, msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (!ret.has_value()) {
+            if (ret.error() == error::posix_error{EAGAIN}) {
+                //Picked back up by dispatch() on the next EPOLLOUT edge
+                state.tx_blocked = true;
+                return;
+            }
+            this->fail_tx(queue, ret.error());
+            return;
+        }
+
+        //A short write means the socket buffer is full, wait for EPOLLOUT rather than retrying
+        const auto sent = ret.value();
+        state.tx_blocked = (sent < total);
+
+        //Popping runs the send callbacks, which may queue more or even remove this handle
+        queue.pop(sent);
+        if (state.generation != generation || state.tx_blocked) {
+            return;
+        }
+    }
 }
 
-void epoll_executor::run_once() {
-    const auto events = this->epoll.wait();
+void epoll_executor::dispatch(epoll_handle_state& state, const struct events event_flags) noexcept {
+    state.event_cache |= event_flags;
+
+    const bool has_error = event_flags.has_error();
+
+    /*
+     * Detach the woken queues before resuming anything
+     * A resumed coroutine may park itself again (which must wait for the next edge, not loop
+     * forever in this pass) or remove the handle entirely, freeing the state we're looking at
+     */
+    auto readers = (event_flags.in || has_error) ? state.read_waiters.take_all() : waiter_queue{};
+    auto writers = (event_flags.out || has_error) ? state.write_waiters.take_all() : waiter_queue{};
+
+    if (event_flags.out && state.tx_blocked) {
+        state.tx_blocked = false;
+        if (state.tx_queue) {
+            this->mark_dirty(state);
+        }
+    }
+
+    //Any woken waiter consumes the readiness, it will retry its syscall until EAGAIN
+    if (!readers.empty()) {
+        state.event_cache.in = false;
+    }
+    if (!writers.empty()) {
+        state.event_cache.out = false;
+    }
+
+    if (has_error) {
+        //The error goes to the head of the queue, reads take priority over writes
+        auto& head_queue = readers.empty() ? writers : readers;
+        if (auto *const head = head_queue.pop()) {
+            head->complete(std::unexpected(pending_error(state.fd, event_flags)));
+        }
+    }
+    //Everyone else retries their operation, and will see the failure from the syscall itself
+    readers.complete_all({});
+    writers.complete_all({});
+}
+
+void epoll_executor::run_once(const std::optional<const std::chrono::milliseconds>& timeout_ms) {
+    //Everything queued since the last iteration goes out before blocking
+    this->flush_dirty();
+
+    const auto events = this->latency ? this->spin_wait(timeout_ms) : this->epoll.wait(timeout_ms);
     if (!events.has_value()) {
         const auto err = events.error();
         if (err == error::posix_error{ETIMEDOUT}) {
@@ -34,18 +601,69 @@ void epoll_executor::run_once() {
     }
     assert(events.has_value());
 
+    //Whole batch is handled in a single pass, nothing here allocates or does a lookup
     std::ranges::for_each(events.value(), [&](const ::epoll_event& epoll_event) {
-        const struct events event_flags = {epoll_event.events};
-        const Handle handle = epoll_event.data.fd;
-        this->handle_map[handle].event_cache = event_flags;
+        const auto token = epoll_token::unpack(epoll_event.data.u64);
+        if (!token.slot) {
+            this->drain_wakeup();
+            return;
+        }
+        if (token.is_stale()) {
+            //Handle was removed (and maybe reused) by a coroutine resumed earlier in this batch
+            return;
+        }
+        this->dispatch(*token.slot, {epoll_event.events});
     });
-    //TODO: What else am I doing other than updating the event cache?
+}
+
+auto epoll_executor::spin_wait(
+        const std::optional<const std::chrono::milliseconds>& timeout_ms) noexcept
+        -> std::expected<const std::span<const ::epoll_event>, error::ErrorCode> {
+    //A zero timeout is a poll, spinning would hold up callers that have other work queued
+    if (timeout_ms && *timeout_ms <= std::chrono::milliseconds{0}) {
+        return this->epoll.wait(timeout_ms);
+    }
+    //Non-blocking polls until the spin budget or the caller's timeout runs out
+    const auto start = std::chrono::steady_clock::now();
+    const auto spin = timeout_ms ? std::min<std::chrono::steady_clock::duration>(
+                                           this->latency->spin, *timeout_ms)
+                                 : this->latency->spin;
+    const auto deadline = start + spin;
+    auto now = start;
+    do {
+        if (auto events = this->epoll.wait(std::chrono::milliseconds{0}); events.has_value()) {
+            return events;
+        }
+        now = std::chrono::steady_clock::now();
+    } while (now < deadline);
+    if (!timeout_ms) {
+        return this->epoll.wait(timeout_ms);
+    }
+    //Only block for whatever is left of the timeout after spinning
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+    return this->epoll.wait(std::max(*timeout_ms - elapsed, std::chrono::milliseconds{0}));
 }
 
 void epoll_executor::run() {
-    while (this->active) {
+    while (this->is_active()) {
         this->run_once();
     }
 }
 
+void epoll_executor::stop() noexcept {
+    this->active.store(false, std::memory_order_release);
+    this->wake();
+}
+
+void epoll_executor::wake() noexcept {
+    const uint64_t one = 1;
+    //EAGAIN means the counter is saturated, which still leaves a wakeup pending
+    [[maybe_unused]] const auto _ = ::write(this->wakeup_fd, &one, sizeof(one));
+}
+
+void epoll_executor::drain_wakeup() noexcept {
+    uint64_t count = 0;
+    [[maybe_unused]] const auto _ = ::read(this->wakeup_fd, &count, sizeof(count));
+}
+
 }; // namespace n3::linux::epoll
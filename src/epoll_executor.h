@@ -1,13 +1,26 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <coroutine>
 #include <cstdint>
+#include <deque>
 #include <exception>
 #include <expected>
-#include <unordered_map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sys/uio.h>
+#include <utility>
+#include <vector>
 
 #include "buffer.h"
+#include "callbacks.h"
 #include "epoll.h"
 #include "error.h"
+#include "frame_allocator.h"
 #include "handle.h"
 #include "ownership.h"
 
@@ -15,21 +28,32 @@ namespace n3::linux::epoll {
 
 //Bit field representing epoll event types as flags
 struct events {
-    unsigned int in : 1;
-    unsigned int out : 1;
-    unsigned int rdhup : 1;
-    unsigned int pri : 1;
-    unsigned int err : 1;
-    unsigned int hup : 1;
+    unsigned int in : 1 = 0;
+    unsigned int out : 1 = 0;
+    unsigned int rdhup : 1 = 0;
+    unsigned int pri : 1 = 0;
+    unsigned int err : 1 = 0;
+    unsigned int hup : 1 = 0;
 
     constexpr events() noexcept = default;
+    //Comparisons against zero are needed, most of the flags don't fit in a single bit as-is
     constexpr events(const uint32_t epoll_events) noexcept :
-            in{epoll_events & EPOLLIN},
-            out{epoll_events & EPOLLOUT},
-            rdhup{epoll_events & EPOLLRDHUP},
-            pri{epoll_events & EPOLLPRI},
-            err{epoll_events & EPOLLERR},
-            hup{epoll_events & EPOLLHUP} {
+            in{(epoll_events & EPOLLIN) != 0},
+            out{(epoll_events & EPOLLOUT) != 0},
+            rdhup{(epoll_events & EPOLLRDHUP) != 0},
+            pri{(epoll_events & EPOLLPRI) != 0},
+            err{(epoll_events & EPOLLERR) != 0},
+            hup{(epoll_events & EPOLLHUP) != 0} {
+    }
+
+    constexpr events& operator|=(const events& other) noexcept {
+        this->in |= other.in;
+        this->out |= other.out;
+        this->rdhup |= other.rdhup;
+        this->pri |= other.pri;
+        this->err |= other.err;
+        this->hup |= other.hup;
+        return *this;
     }
 
     //Sanity check if any events are raised that ARE NOT read or write
@@ -50,12 +74,95 @@ struct events {
     }
 };
 
+//Which readiness a parked coroutine is waiting on
+enum class interest : uint8_t {
+    read,
+    write,
+};
+
+struct epoll_handle_state;
+
+/*
+ * Awaiter returned by epoll_executor::readable()/writable()
+ *
+ * The awaiter lives in the suspended coroutine frame and doubles as the intrusive node of the
+ * per-handle waiter queue, so parking a coroutine never allocates
+ * Resumes with an error instead of a value when the executor sees an error event for the handle
+ * while this awaiter is at the head of the queue
+ */
+struct EpollAwaitable {
+    epoll_handle_state *state;
+    interest direction;
+    std::coroutine_handle<> waiter{};
+    EpollAwaitable *next{nullptr};
+    std::expected<void, error::ErrorCode> result{};
+
+    [[nodiscard]] bool await_ready() noexcept;
+    void await_suspend(std::coroutine_handle<> h) noexcept;
+    [[nodiscard]] std::expected<void, error::ErrorCode> await_resume() const noexcept {
+        return this->result;
+    }
+
+    //Store the result and resume the parked coroutine, *this may be destroyed afterwards
+    void complete(const std::expected<void, error::ErrorCode>& res) noexcept {
+        this->result = res;
+        this->waiter.resume();
+    }
+};
+
+//Intrusive FIFO of parked awaiters, nodes are owned by the coroutine frames themselves
+struct waiter_queue {
+    EpollAwaitable *head{nullptr};
+    EpollAwaitable *tail{nullptr};
+
+    [[nodiscard]] constexpr bool empty() const noexcept {
+        return this->head == nullptr;
+    }
+
+    constexpr void push(EpollAwaitable *const node) noexcept {
+        node->next = nullptr;
+        if (this->tail) {
+            this->tail->next = node;
+        } else {
+            this->head = node;
+        }
+        this->tail = node;
+    }
+
+    [[nodiscard]] constexpr EpollAwaitable *pop() noexcept {
+        auto *const node = this->head;
+        if (node) {
+            this->head = node->next;
+            if (!this->head) {
+                this->tail = nullptr;
+            }
+            node->next = nullptr;
+        }
+        return node;
+    }
+
+    //Detach the whole queue so it can be drained without seeing newly parked waiters
+    [[nodiscard]] constexpr waiter_queue take_all() noexcept {
+        return std::exchange(*this, waiter_queue{});
+    }
+
+    //Resume every waiter in order, popping before resuming since a waiter frame may be destroyed
+    void complete_all(const std::expected<void, error::ErrorCode>& res) noexcept {
+        while (auto *const node = this->pop()) {
+            node->complete(res);
+        }
+    }
+};
+
 //TODO: Naming
 //TODO: Anything else needed to be stored here?
 //TODO: Encapsulation semantics or RAII useful here?
 struct epoll_handle_state {
     //Not an OwnedHandle because this is a weak reference that should not affect lifetimes
-    Handle fd;
+    //Negative while the slot is unused
+    Handle fd{-1};
+    //Bumped every time the slot is released, stale epoll tokens won't match after fd reuse
+    uint16_t generation{0};
     /*
      * TODO: Buffer queues don't make as much sense here after further thought
      * The main "work" horse here is going to be the read/write coroutines that need to be handled
@@ -69,13 +176,302 @@ struct epoll_handle_state {
      * Any error events call the main work queue head event with the error instead of the normal
      * resumption
      */
-    BufferQueue tx_queue;
-    BufferQueue rx_queue;
+    //Lent from the executor's queue_slab on the first send, handed back once it drains
+    BufferQueue *tx_queue{nullptr};
+    //Queued on the executor's dirty list for the next flush
+    bool tx_dirty{false};
+    //Last flush hit EAGAIN, nothing more is attempted until the next EPOLLOUT edge
+    bool tx_blocked{false};
+    //A flush is running this queue's callbacks, remove() leaves the queue for it to fail
+    bool tx_flushing{false};
+    //A pooled recv had readiness but no buffer, the next one claims it once the pool has one
+    bool rx_starved{false};
     /*
      * Current known event values for the handle
      * Is updated by returned epoll events and read/write calls hitting EAGAIN
+     * A readiness bit is consumed by whichever waiter observes it first
      */
     struct events event_cache;
+
+    //Coroutines parked on this handle, split by the readiness they need
+    waiter_queue read_waiters;
+    waiter_queue write_waiters;
+};
+
+/*
+ * Slab of BufferQueues for the per-handle send queues
+ * Most handles are idle most of the time, so a queue is only lent out while a handle has writes
+ * in flight instead of every slot carrying one
+ * Queues live in fixed size chunks threaded onto an intrusive free list, nothing is moved or
+ * freed until the slab goes away, a released queue is destroyed so its entry array goes with it
+ */
+class queue_slab {
+    static constexpr size_t CHUNK_SIZE = 256;
+
+    struct node {
+        union {
+            BufferQueue queue;
+            node *next_free;
+        };
+        bool live{false};
+
+        node() noexcept : next_free{nullptr} {
+        }
+        node(const node&) = delete;
+        node& operator=(const node&) = delete;
+        ~node() {
+            if (this->live) {
+                std::destroy_at(&this->queue);
+            }
+        }
+    };
+    using chunk = std::array<node, CHUNK_SIZE>;
+
+    std::vector<std::unique_ptr<chunk>> chunks;
+    node *free_list{nullptr};
+    size_t in_use{0};
+
+public:
+    queue_slab() noexcept = default;
+
+    //Throws std::bad_alloc if a new chunk is needed and can't be allocated
+    [[nodiscard]] BufferQueue& acquire();
+    //The queue must be empty or its callbacks are dropped without running
+    void release(BufferQueue& queue) noexcept;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return this->in_use;
+    }
+};
+
+class recv_buffer_pool;
+
+/*
+ * Borrowed view of a receive pool buffer
+ * Move only, the buffer goes back to its pool when the view is released or destroyed
+ * A default constructed (or EOF) view is empty and owns nothing
+ */
+class pooled_buffer {
+    recv_buffer_pool *owner;
+    uint32_t id;
+    size_t len;
+
+public:
+    constexpr pooled_buffer() noexcept : owner{nullptr}, id{0}, len{0} {
+    }
+    pooled_buffer(recv_buffer_pool& pool, const uint32_t buffer_id, const size_t length) noexcept :
+            owner{&pool},
+            id{buffer_id},
+            len{length} {
+    }
+    ~pooled_buffer() {
+        this->release();
+    }
+
+    pooled_buffer(const pooled_buffer&) = delete;
+    pooled_buffer(pooled_buffer&& other) noexcept :
+            owner{std::exchange(other.owner, nullptr)},
+            id{other.id},
+            len{std::exchange(other.len, 0)} {
+    }
+
+    pooled_buffer& operator=(const pooled_buffer&) = delete;
+    pooled_buffer& operator=(pooled_buffer&& other) noexcept {
+        if (this != &other) {
+            this->release();
+            this->owner = std::exchange(other.owner, nullptr);
+            this->id = other.id;
+            this->len = std::exchange(other.len, 0);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return this->len == 0;
+    }
+    [[nodiscard]] size_t size() const noexcept {
+        return this->len;
+    }
+    //Only valid until the view is released
+    [[nodiscard]] std::span<std::byte> data() const noexcept;
+
+    //Hands the buffer back to the pool early
+    void release() noexcept;
+};
+
+/*
+ * Pool of equal sized receive buffers shared by every handle on an executor
+ *
+ * The epoll counterpart of io_uring provided buffers, a pooled recv() only borrows a buffer
+ * once its handle is readable, so idle connections don't pin any receive memory
+ * Free buffers are a LIFO stack, the most recently returned (cache warm) buffer goes out next
+ */
+class recv_buffer_pool {
+    std::unique_ptr<std::byte[]> storage;
+    std::vector<uint32_t> free_ids;
+    const size_t buffer_size;
+
+public:
+    //Throws std::bad_alloc
+    recv_buffer_pool(const uint32_t buffer_count, const size_t buf_size);
+
+    recv_buffer_pool(const recv_buffer_pool&) = delete;
+    recv_buffer_pool& operator=(const recv_buffer_pool&) = delete;
+
+    //Empty if every buffer is lent out
+    [[nodiscard]] std::optional<uint32_t> borrow() noexcept {
+        if (this->free_ids.empty()) {
+            return std::nullopt;
+        }
+        const auto id = this->free_ids.back();
+        this->free_ids.pop_back();
+        return id;
+    }
+    //Capacity for every ID is reserved up front, so this never allocates
+    void recycle(const uint32_t id) noexcept {
+        this->free_ids.push_back(id);
+    }
+
+    [[nodiscard]] std::span<std::byte> buffer(const uint32_t id) const noexcept {
+        return {this->storage.get() + (id * this->buffer_size), this->buffer_size};
+    }
+    [[nodiscard]] size_t available() const noexcept {
+        return this->free_ids.size();
+    }
+};
+
+inline std::span<std::byte> pooled_buffer::data() const noexcept {
+    if (!this->owner) {
+        return {};
+    }
+    return this->owner->buffer(this->id).first(this->len);
+}
+
+inline void pooled_buffer::release() noexcept {
+    if (this->owner) {
+        std::exchange(this->owner, nullptr)->recycle(this->id);
+        this->len = 0;
+    }
+}
+
+/*
+ * Awaiter returned by epoll_executor::recv() for pooled receives
+ *
+ * Waits for readability like EpollAwaitable, then borrows a buffer and reads into it
+ * Resumes with the filled buffer, an empty buffer at EOF, ENOBUFS if the pool is empty, or
+ * EAGAIN if another reader drained the socket first
+ * ENOBUFS doesn't leave the handle readable, the readiness is only handed to a later recv once
+ * the pool has a free buffer again, until then a recv waits for the next edge like any other
+ */
+struct pooled_recv_awaitable {
+    EpollAwaitable readiness;
+    //Slot generation at creation, the handle may be removed while a batch is being dispatched
+    uint16_t generation;
+    recv_buffer_pool *pool;
+    int flags;
+    std::optional<std::expected<pooled_buffer, error::ErrorCode>> result{};
+
+    [[nodiscard]] bool await_ready() noexcept;
+    void await_suspend(std::coroutine_handle<> h) noexcept {
+        this->readiness.await_suspend(h);
+    }
+    [[nodiscard]] std::expected<pooled_buffer, error::ErrorCode> await_resume() noexcept;
+
+    [[nodiscard]] std::expected<pooled_buffer, error::ErrorCode> attempt() noexcept;
+};
+
+/*
+ * Token stored in epoll_event.data, a slot pointer tagged with the slot generation
+ * User space pointers only use the low 48 bits on x86-64 and aarch64, so the top 16 bits are free
+ * Dispatching an event is then a pointer dereference and a generation compare, no lookup needed
+ */
+struct epoll_token {
+    static constexpr unsigned int GENERATION_SHIFT = 48;
+    static constexpr uint64_t POINTER_MASK = (uint64_t{1} << GENERATION_SHIFT) - 1;
+
+    epoll_handle_state *slot;
+    uint16_t generation;
+
+    [[nodiscard]] static epoll_token unpack(const uint64_t raw) noexcept {
+        return {
+                .slot = reinterpret_cast<epoll_handle_state *>(raw & POINTER_MASK),
+                .generation = static_cast<uint16_t>(raw >> GENERATION_SHIFT),
+        };
+    }
+
+    [[nodiscard]] uint64_t pack() const noexcept {
+        const auto addr = reinterpret_cast<uintptr_t>(this->slot);
+        assert((addr & ~POINTER_MASK) == 0);
+        return static_cast<uint64_t>(addr) | (uint64_t{this->generation} << GENERATION_SHIFT);
+    }
+
+    //Stale tokens come from events for a handle that was removed (and maybe reused) mid-batch
+    [[nodiscard]] bool is_stale() const noexcept {
+        return this->slot->fd < 0 || this->slot->generation != this->generation;
+    }
+};
+
+/*
+ * Dense table of per-handle state indexed directly by fd
+ * fds are handed out lowest-first by the kernel, so a flat index stays compact
+ * Slots live in fixed size chunks that are never moved or freed while the table exists,
+ * which keeps slot pointers stable enough to give to the kernel as epoll tokens
+ */
+class handle_table {
+    static constexpr size_t CHUNK_SIZE = 1024;
+    using chunk = std::array<epoll_handle_state, CHUNK_SIZE>;
+
+    std::vector<std::unique_ptr<chunk>> chunks;
+    size_t active{0};
+
+public:
+    handle_table() noexcept = default;
+
+    //Slots currently handed out
+    [[nodiscard]] size_t size() const noexcept {
+        return this->active;
+    }
+
+    //Returns nullptr if the fd has no active slot
+    [[nodiscard]] epoll_handle_state *find(const Handle fd) const noexcept {
+        if (fd < 0) {
+            return nullptr;
+        }
+        const auto idx = static_cast<size_t>(fd);
+        if (idx / CHUNK_SIZE >= this->chunks.size() || !this->chunks[idx / CHUNK_SIZE]) {
+            return nullptr;
+        }
+        auto& slot = (*this->chunks[idx / CHUNK_SIZE])[idx % CHUNK_SIZE];
+        return (slot.fd == fd) ? &slot : nullptr;
+    }
+
+    //Activates the slot for the fd, allocating its chunk if needed, throws std::bad_alloc
+    [[nodiscard]] epoll_handle_state& acquire(const Handle fd);
+
+    //Resets the slot and bumps its generation so in-flight tokens become stale
+    void release(epoll_handle_state& slot) noexcept;
+};
+
+/*
+ * Low latency mode, trades CPU for skipping the interrupt to wakeup path
+ * run_once() spins on a non-blocking epoll_wait for up to spin before it blocks, and the
+ * kernel busy polls the sockets' NAPI contexts instead of waiting on interrupts
+ * The spin never outlasts run_once()'s timeout, and a zero timeout stays a single poll
+ */
+struct latency_config {
+    std::chrono::microseconds spin{100};
+    std::chrono::microseconds busy_poll{50};
+    uint16_t busy_poll_budget{8};
+    bool prefer_busy_poll{true};
+};
+
+//Where kernel side busy polling ended up configured
+enum class busy_poll_mode {
+    none,
+    //EPIOCSPARAMS on the epoll instance, covers every socket at once
+    epoll,
+    //Older kernels, SO_BUSY_POLL/SO_PREFER_BUSY_POLL set on each socket as it's added
+    per_socket,
 };
 
 /*
@@ -100,9 +496,70 @@ struct epoll_handle_state {
  */
 class epoll_executor {
     epoll_ctx epoll;
-    bool active;
+    //Cleared by stop(), which may be called from any thread
+    std::atomic<bool> active;
+    //eventfd used to interrupt a blocked epoll_wait from other threads, uses the null token
+    const OwnedHandle wakeup_fd;
+
+    handle_table handles;
+
+    std::optional<latency_config> latency;
+    busy_poll_mode busy_poll;
+
+    /*
+     * Write coalescing
+     * send() only queues on the handle's tx_queue and marks it dirty, every dirty handle is then
+     * flushed once per loop iteration with a single sendmsg over everything it has queued
+     * Buffers up to SMALL_WRITE bytes are copied into the scratch area, so a run of small writes
+     * (headers, trailers) costs one iovec instead of one each
+     */
+    static constexpr size_t SMALL_WRITE = 256;
+    static constexpr size_t SCRATCH_SIZE = 16 * 1024;
 
-    std::unordered_map<Handle, epoll_handle_state> handle_map;
+    //add() keeps room in both for every live handle, so marking one dirty never allocates
+    std::vector<epoll_token> dirty;
+    std::vector<epoll_token> flushing;
+    std::array<::iovec, IOV_MAX> flush_iovecs;
+    std::array<std::byte, SCRATCH_SIZE> flush_scratch;
+    //Set while a failed tx_queue is drained, the queued send callbacks report it instead of a size
+    std::optional<error::ErrorCode> tx_failure;
+
+    using result_callback = n3::callback<std::expected<size_t, error::ErrorCode>>;
+
+    /*
+     * Pooled callback and size of a queued send
+     * The tx_queue callback only points at one of these, a result callback nested inside it
+     * would never fit in the callback's inline storage
+     */
+    struct pending_send {
+        std::optional<result_callback> cb;
+        size_t size;
+        pending_send *next_free;
+    };
+
+    //Deque for stable addresses, entries are recycled through the free list and never released
+    std::deque<pending_send> pending_sends;
+    pending_send *free_pending_sends;
+
+    [[nodiscard]] pending_send& acquire_pending_send(result_callback&& cb, const size_t size);
+    void complete_send(pending_send& op);
+
+    queue_slab tx_queues;
+
+    void reserve_dirty(const size_t handle_count);
+    void mark_dirty(epoll_handle_state& state) noexcept;
+    void flush_dirty() noexcept;
+    void flush(epoll_handle_state& state) noexcept;
+    void write_tx(epoll_handle_state& state, BufferQueue& queue) noexcept;
+    void return_tx(
+            epoll_handle_state& state, BufferQueue& queue, const uint16_t generation) noexcept;
+    void fail_tx(BufferQueue& queue, const error::ErrorCode err) noexcept;
+
+    void dispatch(epoll_handle_state& state, const struct events event_flags) noexcept;
+    [[nodiscard]] auto spin_wait(
+            const std::optional<const std::chrono::milliseconds>& timeout_ms) noexcept
+            -> std::expected<const std::span<const ::epoll_event>, error::ErrorCode>;
+    void drain_wakeup() noexcept;
 
     /*
      * TODO: I can't implement this yet because it's too bleeding edge...
@@ -128,9 +585,95 @@ public:
      *  - Registering read/write events and callbacks (Done in an init function, or per-call?)
      *  - Memory buffer to handle data reads that we can return to the user
      */
+    //Runs until stop() is called, a stop before run() makes it return immediately
     void run();
-    void run_once();
+    void run_once(const std::optional<const std::chrono::milliseconds>& timeout_ms = std::nullopt);
     void run_until();
+
+    /*
+     * Turns on latency mode, socket options only reach handles added after this call
+     * Kernel busy polling is best effort, the user space spin applies regardless
+     */
+    busy_poll_mode enable_latency_mode(const latency_config& config) noexcept;
+    [[nodiscard]] busy_poll_mode busy_poll_state() const noexcept {
+        return this->busy_poll;
+    }
+
+    //Send queues currently lent out, handles with nothing in flight don't hold one
+    [[nodiscard]] size_t tx_queues_in_use() const noexcept {
+        return this->tx_queues.size();
+    }
+
+    //Thread safe, both interrupt a blocked run_once from any thread
+    void stop() noexcept;
+    void wake() noexcept;
+    [[nodiscard]] bool is_active() const noexcept {
+        return this->active.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Awaitables for suspending a coroutine until the handle is readable/writable
+     * The handle must have been added to the executor beforehand, otherwise the awaitable
+     * completes immediately with EBADF
+     *
+     * Usage:
+     *  while (true) {
+     *      auto ret = n3::linux::recv(fd, buf, 0);
+     *      if (!ret && ret.error() == error::posix_error{EAGAIN}) {
+     *          co_await exec.readable(fd);
+     *          continue;
+     *      }
+     *      ...
+     *  }
+     */
+    /*
+     * Queues the buffer behind anything already pending on the handle, nothing is sent until the
+     * executor flushes, so sends never reorder against each other
+     * The callback gets the buffer's size once all of it has been sent, or the error that ended
+     * the flush (ECANCELED if the handle is removed first), the buffer must stay alive until then
+     */
+    void send(Handle fd,
+            const RefBuffer buf,
+            n3::callback<std::expected<size_t, error::ErrorCode>>&& cb);
+    /*
+     * Writes whatever is queued on the handle now instead of waiting for the loop, running the
+     * callbacks of every send it finishes
+     * EAGAIN if some of it is still queued afterwards, so a write that bypasses the queue has to
+     * wait to keep its place in line, a handle that isn't added has nothing queued
+     * From one of the handle's own send callbacks the running flush keeps the queue, this only
+     * reports whether anything is still waiting in it
+     */
+    [[nodiscard]] auto flush(Handle fd) noexcept -> const std::expected<void, error::ErrorCode>;
+
+    [[nodiscard]] auto readable(Handle fd) noexcept -> EpollAwaitable;
+    [[nodiscard]] auto writable(Handle fd) noexcept -> EpollAwaitable;
+
+    /*
+     * Receives into a buffer borrowed from the pool once the handle is readable
+     * The pool must outlive every buffer it lends out
+     *
+     * After ENOBUFS, release buffers before retrying, a retry against an empty pool parks until
+     * more data arrives rather than failing again
+     *
+     * Usage:
+     *  while (true) {
+     *      auto buf = co_await exec.recv(fd, pool);
+     *      if (!buf && buf.error() == error::posix_error{EAGAIN}) {
+     *          continue;
+     *      }
+     *      if (!buf && buf.error() == error::posix_error{ENOBUFS}) {
+     *          //Every buffer is lent out, the data is still waiting in the socket
+     *          release_held_buffers();
+     *          continue;
+     *      }
+     *      if (!buf || buf->empty()) {
+     *          break;
+     *      }
+     *      consume(buf->data());
+     *  }
+     */
+    [[nodiscard]] auto recv(Handle fd, recv_buffer_pool& pool, const int flags = 0) noexcept
+            -> pooled_recv_awaitable;
 };
 
 //TODO: Generalize beyond epoll executor type whenever those exist
@@ -172,12 +715,16 @@ public:
 };
 
 class EpollTask {
+public:
     struct promise_type;
+
+private:
     using handle_type = std::coroutine_handle<promise_type>;
 
     OwnedCoroutine<promise_type> coro_handle;
 
-    struct promise_type {
+public:
+    struct promise_type : n3::pooled_frame {
         struct events epoll_events;
         std::exception_ptr eptr;
 
@@ -197,20 +744,20 @@ class EpollTask {
         }
     };
 
-public:
     EpollTask() noexcept = default;
     EpollTask(handle_type handle) noexcept : coro_handle{handle} {
     }
-};
 
-struct EpollAwaitable {
-    bool await_ready() {
-        return false;
-    }
-    void await_suspend(std::coroutine_handle<> h) {
-        h.resume();
+    /*
+     * Run the task until its first suspension point
+     * Afterwards the executor resumes it, so the task object must outlive any parked awaiters
+     */
+    void start() const {
+        this->coro_handle.resume();
     }
-    void await_resume() {
+
+    [[nodiscard]] bool done() const {
+        return this->coro_handle.done();
     }
 };
 
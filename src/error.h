@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <concepts>
 #include <cstring>
 #include <netdb.h>
 #include <optional>
@@ -51,10 +52,14 @@ class ErrorCode {
 public:
     constexpr ErrorCode() noexcept = default;
 
-    //Constructor for anything that can be used to create the underlying variant
+    /*
+     * Constructor for anything that can be used to create the underlying variant
+     * Constrained so it doesn't hijack copies from non-const lvalues of ErrorCode itself
+     */
     constexpr ErrorCode(auto&&...args) noexcept(
-            std::is_nothrow_constructible_v<decltype(underlying), decltype(args)...>) :
-            underlying{std::forward<decltype(args)>(args)...} {
+            std::is_nothrow_constructible_v<decltype(underlying), decltype(args)...>)
+        requires std::constructible_from<decltype(underlying), decltype(args)...>
+            : underlying{std::forward<decltype(args)>(args)...} {
     }
 
     //Explicit error type constructor for posix errors using a trivial sentinel type
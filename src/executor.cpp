@@ -0,0 +1,207 @@
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <liburing.h>
+#include <memory>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+#include "executor.h"
+
+#include "error.h"
+#include "handle.h"
+
+namespace n3::linux {
+
+namespace {
+
+//Buffer group registered on the trial ring, nothing else ever sees that ring
+constexpr int PROBE_GROUP = 0;
+
+//Tries a tiny ring with the given setup flags, only the return value matters
+[[nodiscard]] bool setup_flags_supported(const unsigned int flags) noexcept {
+    ::io_uring ring{};
+    ::io_uring_params params{};
+    params.flags = flags;
+    if (::io_uring_queue_init_params(4, &ring, &params) != 0) {
+        return false;
+    }
+    ::io_uring_queue_exit(&ring);
+    return true;
+}
+
+/*
+ * Submits the one prepared SQE and returns the result and flags of its first CQE
+ * Callers make sure the operation can complete right away, so this never waits on the network
+ */
+[[nodiscard]] std::pair<int, unsigned int> first_completion(::io_uring& ring) noexcept {
+    ::io_uring_cqe *cqe = nullptr;
+    if (::io_uring_submit(&ring) != 1 || ::io_uring_wait_cqe(&ring, &cqe) != 0) {
+        return {-EIO, 0};
+    }
+    const std::pair result{cqe->res, cqe->flags};
+    ::io_uring_cqe_seen(&ring, cqe);
+    return result;
+}
+
+//Receives a byte that is already waiting, kernels before 6.0 reject the multishot flag
+[[nodiscard]] bool multishot_recv_supported(::io_uring& ring, ::io_uring_buf_ring& br) noexcept {
+    std::array<int, 2> fds{};
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()) != 0) {
+        return false;
+    }
+    const OwnedHandle lhs{fds[0]};
+    const OwnedHandle rhs{fds[1]};
+
+    //Only buffer in the ring, it's consumed by the one receive so the kernel is done with it
+    std::array<std::byte, 1> storage{};
+    ::io_uring_buf_ring_add(&br, storage.data(), storage.size(), 0, ::io_uring_buf_ring_mask(1), 0);
+    ::io_uring_buf_ring_advance(&br, 1);
+    if (::write(rhs, storage.data(), storage.size()) != 1) {
+        return false;
+    }
+
+    auto *const sqe = ::io_uring_get_sqe(&ring);
+    if (!sqe) {
+        return false;
+    }
+    ::io_uring_prep_recv_multishot(sqe, lhs, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = PROBE_GROUP;
+    const auto [res, flags] = first_completion(ring);
+    return res == 1 && (flags & IORING_CQE_F_MORE) != 0;
+}
+
+//Accepts a connection that is already queued, kernels before 5.19 reject the multishot flag
+[[nodiscard]] bool multishot_accept_supported(::io_uring& ring) noexcept {
+    const OwnedHandle listener{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (listener < 0) {
+        return false;
+    }
+    //Binding only the family autobinds to a free abstract address
+    ::sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    ::socklen_t addr_len = sizeof(addr.sun_family);
+    if (::bind(listener, reinterpret_cast<const ::sockaddr *>(&addr), addr_len) != 0
+            || ::listen(listener, 1) != 0) {
+        return false;
+    }
+    addr_len = sizeof(addr);
+    if (::getsockname(listener, reinterpret_cast<::sockaddr *>(&addr), &addr_len) != 0) {
+        return false;
+    }
+    const OwnedHandle client{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (client < 0
+            || ::connect(client, reinterpret_cast<const ::sockaddr *>(&addr), addr_len) != 0) {
+        return false;
+    }
+
+    auto *const sqe = ::io_uring_get_sqe(&ring);
+    if (!sqe) {
+        return false;
+    }
+    ::io_uring_prep_multishot_accept(sqe, listener, nullptr, nullptr, SOCK_CLOEXEC);
+    const auto [res, flags] = first_completion(ring);
+    if (res >= 0) {
+        ::close(res);
+    }
+    return res >= 0 && (flags & IORING_CQE_F_MORE) != 0;
+}
+
+//Everything that has to be tried on a ring rather than looked up in the opcode probe
+void probe_trial_ring(kernel_features& features) noexcept {
+    ::io_uring ring{};
+    if (::io_uring_queue_init(4, &ring, 0) != 0) {
+        return;
+    }
+
+    features.sparse_files = ::io_uring_register_files_sparse(&ring, 1) == 0;
+    features.multishot_accept = multishot_accept_supported(ring);
+
+    int ret = 0;
+    auto *const br = ::io_uring_setup_buf_ring(&ring, 1, PROBE_GROUP, 0, &ret);
+    features.buf_ring = (br != nullptr);
+    if (br) {
+        features.multishot_recv = multishot_recv_supported(ring, *br);
+        ::io_uring_free_buf_ring(&ring, br, 1, PROBE_GROUP);
+    }
+
+    //Also cancels the multishot operations, which are still armed
+    ::io_uring_queue_exit(&ring);
+}
+
+} // namespace
+
+[[nodiscard]] kernel_features probe_kernel() noexcept {
+    kernel_features features{};
+
+    //Null if io_uring is missing entirely, or disabled through kernel.io_uring_disabled
+    const std::unique_ptr<::io_uring_probe, decltype(&::io_uring_free_probe)> probe{
+            ::io_uring_get_probe(), &::io_uring_free_probe};
+    if (!probe) {
+        return features;
+    }
+
+    const auto supported
+            = [&](const int op) { return ::io_uring_opcode_supported(probe.get(), op) != 0; };
+    features.send_zc = supported(IORING_OP_SEND_ZC);
+
+    features.single_issuer = setup_flags_supported(IORING_SETUP_SINGLE_ISSUER);
+    features.defer_taskrun = features.single_issuer
+            && setup_flags_supported(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+    features.coop_taskrun = setup_flags_supported(IORING_SETUP_COOP_TASKRUN);
+    features.sqpoll = setup_flags_supported(IORING_SETUP_SQPOLL);
+    probe_trial_ring(features);
+
+    features.io_uring = supported(IORING_OP_RECV) && supported(IORING_OP_SEND)
+            && supported(IORING_OP_READ) && supported(IORING_OP_WRITE)
+            && supported(IORING_OP_ACCEPT) && supported(IORING_OP_ASYNC_CANCEL)
+            && supported(IORING_OP_POLL_ADD) && features.buf_ring;
+
+    return features;
+}
+
+[[nodiscard]] std::optional<backend> backend_from_env() noexcept {
+    const char *const value = std::getenv("N3_BACKEND");
+    if (!value) {
+        return std::nullopt;
+    }
+    const std::string_view name{value};
+    if (name == "epoll") {
+        return backend::epoll;
+    }
+    if (name == "io_uring") {
+        return backend::io_uring;
+    }
+    return std::nullopt;
+}
+
+executor::executor(const backend choice, const io_uring::ring_config& config) :
+        impl{},
+        selected{backend::epoll} {
+    const auto wanted = (choice == backend::automatic)
+            ? backend_from_env().value_or(backend::automatic)
+            : choice;
+
+    if (wanted == backend::io_uring
+            || (wanted == backend::automatic && probe_kernel().io_uring)) {
+        try {
+            this->impl.emplace<io_uring::Executor>(config);
+            this->selected = backend::io_uring;
+            return;
+        } catch (const error::ErrorCode&) {
+            //Probing can't catch everything, such as seccomp filters or memlock limits
+            if (wanted == backend::io_uring) {
+                throw;
+            }
+        }
+    }
+    this->impl.emplace<epoll::epoll_executor>();
+    this->selected = backend::epoll;
+}
+
+} // namespace n3::linux
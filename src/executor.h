@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <utility>
+#include <variant>
+
+#include "epoll_executor.h"
+#include "io_uring.h"
+
+/**
+ * Backend selection between the epoll and io_uring executors
+ *
+ * The kernel is probed once at startup instead of picking a backend at compile time, so the same
+ * binary gets io_uring where it's usable and falls back to epoll everywhere else
+ */
+
+namespace n3::linux {
+
+enum class backend {
+    automatic,
+    epoll,
+    io_uring,
+};
+
+//What the running kernel supports, gathered by probe_kernel()
+struct kernel_features {
+    //Every opcode the io_uring executor submits is supported, and buffer rings can be registered
+    bool io_uring{false};
+    bool send_zc{false};
+    //Provided buffer rings (5.19), which buffer_ring and multishot_recv draw from
+    bool buf_ring{false};
+    //Multishot recv (6.0) and accept (5.19), neither has an opcode of its own to look up
+    bool multishot_recv{false};
+    bool multishot_accept{false};
+    //Sparse registered file tables, without them the executor sticks to plain fds
+    bool sparse_files{false};
+    //Setup flags that a trial ring accepted
+    bool single_issuer{false};
+    bool defer_taskrun{false};
+    bool coop_taskrun{false};
+    bool sqpoll{false};
+};
+
+/*
+ * Uses io_uring_get_probe and throwaway rings, so it's meant to be called once at startup
+ * Features without an opcode are tried for real on a trial ring, over a socketpair and a unix
+ * listener that are closed again before returning
+ */
+[[nodiscard]] kernel_features probe_kernel() noexcept;
+
+//Parses N3_BACKEND ("epoll" or "io_uring"), empty if unset or unrecognised
+[[nodiscard]] std::optional<backend> backend_from_env() noexcept;
+
+/*
+ * Executor facade holding whichever backend was selected
+ *
+ * Dispatch is a branch on the variant index, never a virtual call, and callers that want
+ * backend specific operations get the concrete executor type inside visit()
+ * Forcing a backend that fails to initialise throws, automatic selection falls back to epoll
+ */
+class executor {
+    //monostate only until the constructor has picked a backend, neither executor is movable
+    std::variant<std::monostate, epoll::epoll_executor, io_uring::Executor> impl;
+    backend selected;
+
+public:
+    //The ring config only applies if io_uring ends up selected
+    explicit executor(const backend choice = backend::automatic,
+            const io_uring::ring_config& config = {});
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    [[nodiscard]] backend active_backend() const noexcept {
+        return this->selected;
+    }
+
+    //Both branches have to return the same type, same as std::visit
+    template<typename F>
+    decltype(auto) visit(F&& func) {
+        if (auto *const uring = std::get_if<io_uring::Executor>(&this->impl)) {
+            return std::invoke(std::forward<F>(func), *uring);
+        }
+        return std::invoke(std::forward<F>(func), std::get<epoll::epoll_executor>(this->impl));
+    }
+
+    void run() {
+        this->visit([](auto& exec) { exec.run(); });
+    }
+    void stop() noexcept {
+        this->visit([](auto& exec) noexcept { exec.stop(); });
+    }
+};
+
+} // namespace n3::linux
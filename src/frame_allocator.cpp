@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "frame_allocator.h"
+
+namespace n3 {
+
+namespace {
+
+    [[nodiscard]] constexpr size_t size_class(const size_t size) noexcept {
+        return (size + FRAME_GRANULE - 1) / FRAME_GRANULE - 1;
+    }
+
+    //Intrusive node written into the freed frame itself
+    struct free_frame {
+        free_frame *next;
+    };
+
+    /*
+     * Set once this thread's pool is destroyed, a frame freed by a later thread_local destructor
+     * goes straight back to operator delete instead of onto the dead freelist
+     * Trivially destructible so it stays readable for the rest of thread exit
+     */
+    thread_local bool pool_dead = false;
+
+    struct frame_pool {
+        std::array<free_frame *, FRAME_CLASSES> heads{};
+        std::array<size_t, FRAME_CLASSES> counts{};
+        frame_stats stats{};
+
+        frame_pool() noexcept = default;
+        frame_pool(const frame_pool&) = delete;
+        frame_pool& operator=(const frame_pool&) = delete;
+
+        //Thread exit, hand every cached block back
+        ~frame_pool() {
+            pool_dead = true;
+            for (size_t cls = 0; cls < FRAME_CLASSES; ++cls) {
+                while (this->heads[cls]) {
+                    auto *const node = std::exchange(this->heads[cls], this->heads[cls]->next);
+                    ::operator delete(static_cast<void *>(node), (cls + 1) * FRAME_GRANULE);
+                }
+            }
+        }
+    };
+
+    thread_local frame_pool pool;
+
+} // namespace
+
+[[nodiscard]] void *allocate_frame(const size_t size) {
+    if (pool_dead) {
+        //Same rounding as a pooled block so the sized delete matches either way
+        const auto pooled = size != 0 && size <= MAX_POOLED_FRAME;
+        return ::operator new(pooled ? (size_class(size) + 1) * FRAME_GRANULE : size);
+    }
+    auto& stats = pool.stats;
+    ++stats.allocations;
+    ++stats.live;
+    stats.peak_live = std::max(stats.peak_live, stats.live);
+    stats.largest = std::max(stats.largest, size);
+
+    if (size == 0 || size > MAX_POOLED_FRAME) {
+        ++stats.unpooled;
+        ++stats.by_size.back();
+        try {
+            return ::operator new(size);
+        } catch (...) {
+            --stats.live;
+            throw;
+        }
+    }
+
+    const auto cls = size_class(size);
+    ++stats.by_size[cls];
+    if (auto *const node = pool.heads[cls]) {
+        pool.heads[cls] = node->next;
+        --pool.counts[cls];
+        ++stats.reused;
+        return node;
+    }
+    try {
+        return ::operator new((cls + 1) * FRAME_GRANULE);
+    } catch (...) {
+        --stats.live;
+        throw;
+    }
+}
+
+void deallocate_frame(void *const ptr, const size_t size) noexcept {
+    if (size == 0 || size > MAX_POOLED_FRAME) {
+        if (!pool_dead) {
+            --pool.stats.live;
+        }
+        ::operator delete(ptr, size);
+        return;
+    }
+
+    const auto cls = size_class(size);
+    if (pool_dead) {
+        ::operator delete(ptr, (cls + 1) * FRAME_GRANULE);
+        return;
+    }
+    --pool.stats.live;
+    if (pool.counts[cls] >= MAX_CACHED_FRAMES) {
+        ::operator delete(ptr, (cls + 1) * FRAME_GRANULE);
+        return;
+    }
+    pool.heads[cls] = ::new (ptr) free_frame{pool.heads[cls]};
+    ++pool.counts[cls];
+}
+
+[[nodiscard]] frame_stats thread_frame_stats() noexcept {
+    return pool.stats;
+}
+
+void reset_thread_frame_stats() noexcept {
+    //Live frames are still outstanding, only the counters start over
+    const auto live = pool.stats.live;
+    pool.stats = {};
+    pool.stats.live = live;
+    pool.stats.peak_live = live;
+}
+
+} // namespace n3
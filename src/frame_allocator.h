@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace n3 {
+
+/*
+ * Coroutine frame allocator
+ *
+ * Frames are rounded up to a multiple of FRAME_GRANULE and served from per-thread freelists,
+ * one per size class, so a short-lived coroutine per request stops costing a malloc/free pair
+ * Blocks come from global operator new and carry no owner, a frame resumed and destroyed on a
+ * different worker (work stealing) simply lands on that worker's freelist
+ * Frames above MAX_POOLED_FRAME go straight to operator new, they're rare and would pin memory
+ */
+inline constexpr size_t FRAME_GRANULE = 64;
+inline constexpr size_t MAX_POOLED_FRAME = 2048;
+inline constexpr size_t FRAME_CLASSES = MAX_POOLED_FRAME / FRAME_GRANULE;
+//Blocks kept per size class on a thread, anything freed past this goes back to operator new
+inline constexpr size_t MAX_CACHED_FRAMES = 256;
+
+//Calling thread's frame statistics, per size class plus one bucket for unpooled frames
+struct frame_stats {
+    uint64_t allocations;
+    //Allocations served from a freelist instead of operator new
+    uint64_t reused;
+    uint64_t unpooled;
+    //Net frames allocated minus freed here, negative on a thread that destroys stolen work
+    int64_t live;
+    int64_t peak_live;
+    size_t largest;
+    std::array<uint64_t, FRAME_CLASSES + 1> by_size;
+};
+
+[[nodiscard]] void *allocate_frame(const size_t size);
+void deallocate_frame(void *const ptr, const size_t size) noexcept;
+
+[[nodiscard]] frame_stats thread_frame_stats() noexcept;
+void reset_thread_frame_stats() noexcept;
+
+/*
+ * Mixin for promise types, routes the frame through the pooled allocator
+ * Uses the sized delete so the size class doesn't need a header in front of the frame
+ */
+struct pooled_frame {
+    [[nodiscard]] static void *operator new(const size_t size) {
+        return allocate_frame(size);
+    }
+    static void operator delete(void *const ptr, const size_t size) noexcept {
+        deallocate_frame(ptr, size);
+    }
+};
+
+} // namespace n3
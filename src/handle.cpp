@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include <utility>
 
 #include "handle.h"
 
@@ -9,7 +10,19 @@ OwnedHandle::OwnedHandle(const int fd_arg) noexcept : fd{fd_arg} {
 
 OwnedHandle::~OwnedHandle() {
     //No good way to handle error returns, maybe an eventual "cleanup error callback function?"
-    close(this->fd);
+    if (this->fd.has_value() && *this->fd >= 0) {
+        close(*this->fd);
+    }
+}
+
+OwnedHandle& OwnedHandle::operator=(OwnedHandle&& other) noexcept {
+    if (this != &other) {
+        if (this->fd.has_value() && *this->fd >= 0) {
+            close(*this->fd);
+        }
+        this->fd = std::move(other.fd);
+    }
+    return *this;
 }
 
 } // namespace n3
@@ -7,15 +7,27 @@ namespace n3 {
 using Handle = int;
 
 class OwnedHandle {
-    const MoveOnly<Handle> fd;
+    MoveOnly<Handle> fd;
 
 public:
     explicit OwnedHandle(const Handle fd_arg) noexcept;
     ~OwnedHandle();
 
-    //Conversion operator to treat this as a plain handle type
+    //Move constructible only
+    OwnedHandle(const OwnedHandle&) = delete;
+    OwnedHandle(OwnedHandle&&) noexcept = default;
+
+    //Move assignable only, closes the currently owned handle first
+    OwnedHandle& operator=(const OwnedHandle&) = delete;
+    OwnedHandle& operator=(OwnedHandle&& other) noexcept;
+
+    /*
+     * Conversion operator to treat this as a plain handle type
+     * Needs the explicit dereference, MoveOnly only converts to bool on its own
+     * Moved-from handles report -1 like any other invalid handle
+     */
     [[nodiscard]] constexpr operator Handle() const noexcept {
-        return this->fd;
+        return this->fd.has_value() ? *this->fd : -1;
     }
 };
 
@@ -1,29 +1,91 @@
+#include <algorithm>
+#include <cerrno>
 #include <liburing.h>
+#include <new>
+#include <poll.h>
+#include <ranges>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "io_uring.h"
 
+#include "page_size.h"
+#include "syscalls.h"
+
+#include "error.h"
+#include "handle.h"
+
 namespace n3::linux::io_uring {
 
-static constexpr unsigned int IO_URING_SQ_LEN = 1024;
-static constexpr unsigned int IO_URING_CQ_LEN = 32768;
+//Upper bound on the registered file table, split between add() and direct descriptors
+static constexpr ::rlim_t MAX_FIXED_FILES = 65536;
 
-io_uring_handle::io_uring_handle() : ring{} {
-    io_uring_params params;
-    memset(&params, 0, sizeof(params));
+namespace {
 
-    params.sq_entries = IO_URING_SQ_LEN;
-    params.cq_entries = IO_URING_CQ_LEN;
-    params.flags = (IORING_SETUP_SQPOLL | IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP
-            | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+[[nodiscard]] ::io_uring_params make_params(
+        const ring_config& config, const ring_mode mode) noexcept {
+    ::io_uring_params params{};
+    params.sq_entries = config.sq_entries;
+    params.cq_entries = config.cq_entries;
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
 
-    int ret = io_uring_queue_init_params(IO_URING_SQ_LEN, &*this->ring, &params);
-    if (ret != 0) {
-        throw error::get_error_code_from_errno(-ret);
+    switch (mode) {
+        case ring_mode::sqpoll:
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = static_cast<__u32>(config.sq_idle.count());
+            if (config.sq_cpu.has_value()) {
+                params.flags |= IORING_SETUP_SQ_AFF;
+                params.sq_thread_cpu = *config.sq_cpu;
+            }
+            break;
+        case ring_mode::defer_taskrun:
+            //DEFER_TASKRUN requires SINGLE_ISSUER, COOP_TASKRUN stops task work from IPIing us
+            params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN
+                    | IORING_SETUP_COOP_TASKRUN;
+            break;
+        case ring_mode::plain:
+            break;
+    }
+    return params;
+}
+
+//The cheaper mode to try when the kernel rejects this one
+[[nodiscard]] constexpr std::optional<ring_mode> fallback_mode(const ring_mode mode) noexcept {
+    switch (mode) {
+        case ring_mode::sqpoll:
+            return ring_mode::defer_taskrun;
+        case ring_mode::defer_taskrun:
+            return ring_mode::plain;
+        case ring_mode::plain:
+            return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+io_uring_handle::io_uring_handle(const ring_config& config) :
+        ring{},
+        active_mode{config.mode} {
+    std::optional<ring_mode> mode = config.mode;
+    int ret = 0;
+    while (mode.has_value()) {
+        auto params = make_params(config, *mode);
+        ret = io_uring_queue_init_params(config.sq_entries, &*this->ring, &params);
+        if (ret == 0) {
+            this->active_mode = *mode;
+            break;
+        }
+        //EINVAL for unknown flags, EPERM for SQPOLL without privileges on older kernels
+        mode = config.fallback ? fallback_mode(*mode) : std::nullopt;
     }
-    ret = io_uring_register_ring_fd(&*this->ring);
     if (ret != 0) {
         throw error::get_error_code_from_errno(-ret);
     }
+
+    //Only saves an fdget per io_uring_enter, so kernels without it just skip it
+    [[maybe_unused]] const auto _ = io_uring_register_ring_fd(&*this->ring);
 }
 
 io_uring_handle::~io_uring_handle() {
@@ -41,4 +103,725 @@ io_uring_handle::~io_uring_handle() {
     return std::nullopt;
 }
 
+buffer_ring::buffer_ring(io_uring_handle& handle,
+        const uint16_t group,
+        const uint16_t entry_count,
+        const size_t buf_size) :
+        ring{handle.get()},
+        br{nullptr},
+        storage{nullptr, aligned_delete{GetPageSize()}},
+        group_id{group},
+        entries{entry_count},
+        buffer_size{buf_size} {
+    assert(this->entries > 0 && (this->entries & (this->entries - 1)) == 0);
+
+    const auto page_size = GetPageSize();
+    this->storage.reset(static_cast<std::byte *>(::operator new[](
+            this->entries * this->buffer_size, static_cast<std::align_val_t>(page_size))));
+
+    int ret = 0;
+    this->br = ::io_uring_setup_buf_ring(this->ring, this->entries, this->group_id, 0, &ret);
+    if (!this->br) {
+        throw error::get_error_code_from_errno(-ret);
+    }
+
+    //Hand every buffer to the kernel up front, then publish them all with one tail update
+    const auto mask = ::io_uring_buf_ring_mask(this->entries);
+    for (uint16_t bid = 0; bid < this->entries; ++bid) {
+        const auto buf = this->buffer(bid);
+        ::io_uring_buf_ring_add(this->br, buf.data(), buf.size(), bid, mask, bid);
+    }
+    ::io_uring_buf_ring_advance(this->br, this->entries);
+}
+
+buffer_ring::~buffer_ring() {
+    if (this->br) {
+        ::io_uring_free_buf_ring(this->ring, this->br, this->entries, this->group_id);
+    }
+}
+
+void buffer_ring::recycle(const uint16_t bid) noexcept {
+    const auto buf = this->buffer(bid);
+    ::io_uring_buf_ring_add(
+            this->br, buf.data(), buf.size(), bid, ::io_uring_buf_ring_mask(this->entries), 0);
+    ::io_uring_buf_ring_advance(this->br, 1);
+}
+
+registered_buffer_pool::registered_buffer_pool(
+        io_uring_handle& handle, const uint16_t slab_count, const size_t slab_bytes) :
+        ring{handle.get()},
+        storage{nullptr, aligned_delete{GetPageSize()}},
+        count{slab_count},
+        slab_size{slab_bytes},
+        free_slabs{} {
+    const auto page_size = GetPageSize();
+    assert(this->count > 0);
+    assert(this->slab_size > 0 && this->slab_size % page_size == 0);
+
+    this->storage.reset(static_cast<std::byte *>(::operator new[](
+            this->count * this->slab_size, static_cast<std::align_val_t>(page_size))));
+
+    std::vector<::iovec> iovecs;
+    iovecs.reserve(this->count);
+    this->free_slabs.reserve(this->count);
+    for (uint16_t i = 0; i < this->count; ++i) {
+        const auto buf = this->slab(i);
+        iovecs.push_back({buf.data(), buf.size()});
+        //Reversed so the lowest slabs are handed out first
+        this->free_slabs.push_back(this->count - i - 1);
+    }
+
+    const auto ret = ::io_uring_register_buffers(this->ring, iovecs.data(), iovecs.size());
+    if (ret != 0) {
+        throw error::get_error_code_from_errno(-ret);
+    }
+}
+
+registered_buffer_pool::~registered_buffer_pool() {
+    ::io_uring_unregister_buffers(this->ring);
+}
+
+bool fixed_send_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        this->res = -EBUSY;
+        return false;
+    }
+    ::io_uring_prep_send_zc_fixed(sqe,
+            this->file.index,
+            this->buf.buf.data(),
+            this->buf.buf.size(),
+            this->flags,
+            0,
+            this->buf.index);
+    this->file.apply(*sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(this));
+    this->waiter = h;
+    return true;
+}
+
+multishot_recv::multishot_recv(Executor& executor, const Handle sock, buffer_ring& ring) :
+        operation{&multishot_recv::complete},
+        exec{executor},
+        fd{sock},
+        buffers{ring},
+        handler{},
+        //Every buffer the ring owns, plus the final result that ends an arming
+        pending(static_cast<size_t>(ring.size()) + 1),
+        pending_head{0},
+        pending_count{0},
+        waiter{},
+        armed{false} {
+}
+
+multishot_recv::multishot_recv(
+        Executor& executor, const Handle sock, buffer_ring& ring, handler_type&& func) :
+        operation{&multishot_recv::complete},
+        exec{executor},
+        fd{sock},
+        buffers{ring},
+        handler{std::move(func)},
+        //Results go straight to the handler, nothing is ever queued
+        pending{},
+        pending_head{0},
+        pending_count{0},
+        waiter{},
+        armed{false} {
+}
+
+multishot_recv::~multishot_recv() {
+    //The kernel still holds our address as user_data while armed
+    assert(!this->armed);
+}
+
+[[nodiscard]] std::expected<void, error::ErrorCode> multishot_recv::start() noexcept {
+    if (this->armed) {
+        return {};
+    }
+    //Another final result wouldn't fit behind the last one, which is what bounds the queue
+    if (this->pending_count > 0) {
+        return std::unexpected(error::get_error_code_from_errno(EBUSY));
+    }
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        return std::unexpected(error::get_error_code_from_errno(EBUSY));
+    }
+    const auto file = this->exec.target(this->fd);
+    ::io_uring_prep_recv_multishot(sqe, file.index, nullptr, 0, 0);
+    file.apply(*sqe);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = this->buffers.group();
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(this));
+    this->armed = true;
+    return {};
+}
+
+void multishot_recv::cancel() noexcept {
+    if (!this->armed) {
+        return;
+    }
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        return;
+    }
+    //The cancel's own CQE has nobody waiting on it, the recv ends with a final -ECANCELED CQE
+    ::io_uring_prep_cancel(sqe, static_cast<operation *>(this), 0);
+    ::io_uring_sqe_set_data(sqe, nullptr);
+}
+
+void multishot_recv::complete(operation *op, const ::io_uring_cqe& cqe) noexcept {
+    auto *const self = static_cast<multishot_recv *>(op);
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        //Final CQE for this SQE, nothing references us anymore
+        self->armed = false;
+    }
+
+    item_type item = [&]() -> item_type {
+        if (cqe.res < 0) {
+            return std::unexpected(error::get_error_code_from_errno(-cqe.res));
+        }
+        if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+            //EOF, no buffer was selected
+            return provided_buffer{};
+        }
+        const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        return provided_buffer{self->buffers, bid, static_cast<size_t>(cqe.res)};
+    }();
+
+    if (self->handler) {
+        self->handler(std::move(item));
+        return;
+    }
+    self->push_pending(std::move(item));
+    if (self->waiter) {
+        std::exchange(self->waiter, nullptr).resume();
+    }
+}
+
+void multishot_recv::push_pending(item_type&& item) noexcept {
+    assert(this->pending_count < this->pending.size());
+    const auto tail = (this->pending_head + this->pending_count) % this->pending.size();
+    this->pending[tail] = std::move(item);
+    ++this->pending_count;
+}
+
+[[nodiscard]] multishot_recv::item_type multishot_recv::pop_pending() noexcept {
+    assert(this->pending_count > 0);
+    //A moved-from buffer view owns nothing, so the slot can simply be overwritten later
+    auto item = std::move(this->pending[this->pending_head]);
+    this->pending_head = (this->pending_head + 1) % this->pending.size();
+    --this->pending_count;
+    return item;
+}
+
+multishot_accept::multishot_accept(
+        Executor& executor, const Handle sock, const int flags) noexcept :
+        operation{&multishot_accept::complete},
+        exec{executor},
+        listener{sock},
+        accept_flags{flags},
+        handler{},
+        pending{},
+        waiter{},
+        armed{false} {
+}
+
+multishot_accept::multishot_accept(
+        Executor& executor, const Handle sock, handler_type&& func, const int flags) noexcept :
+        operation{&multishot_accept::complete},
+        exec{executor},
+        listener{sock},
+        accept_flags{flags},
+        handler{std::move(func)},
+        pending{},
+        waiter{},
+        armed{false} {
+}
+
+multishot_accept::~multishot_accept() {
+    //The kernel still holds our address as user_data while armed
+    assert(!this->armed);
+    //Connections nobody picked up are still ours to close
+    for (const auto& item : this->pending) {
+        if (item.has_value()) {
+            ::close(item->fd);
+        }
+    }
+}
+
+[[nodiscard]] std::expected<void, error::ErrorCode> multishot_accept::start() noexcept {
+    if (this->armed) {
+        return {};
+    }
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        return std::unexpected(error::get_error_code_from_errno(EBUSY));
+    }
+    const auto file = this->exec.target(this->listener);
+    ::io_uring_prep_multishot_accept(sqe, file.index, nullptr, nullptr, this->accept_flags);
+    file.apply(*sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(this));
+    this->armed = true;
+    return {};
+}
+
+void multishot_accept::cancel() noexcept {
+    if (!this->armed) {
+        return;
+    }
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_cancel(sqe, static_cast<operation *>(this), 0);
+    ::io_uring_sqe_set_data(sqe, nullptr);
+}
+
+void multishot_accept::complete(operation *op, const ::io_uring_cqe& cqe) noexcept {
+    auto *const self = static_cast<multishot_accept *>(op);
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        self->armed = false;
+    }
+
+    item_type item = [&]() -> item_type {
+        if (cqe.res < 0) {
+            return std::unexpected(error::get_error_code_from_errno(-cqe.res));
+        }
+        return accepted_socket{cqe.res};
+    }();
+
+    if (self->handler) {
+        self->handler(std::move(item));
+        return;
+    }
+    try {
+        self->pending.push_back(std::move(item));
+    } catch (const std::bad_alloc&) {
+        //Nowhere to keep it, and nobody else has seen the handle yet
+        if (item.has_value()) {
+            ::close(item->fd);
+        }
+        return;
+    }
+    if (self->waiter) {
+        std::exchange(self->waiter, nullptr).resume();
+    }
+}
+
+Executor::Executor(const ring_config& config) :
+        uring{config},
+        active{true},
+        wakeup_fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+        wakeup_op{{&Executor::complete_wakeup}, this, false},
+        fixed_slots{0},
+        fixed_index{},
+        free_slots{},
+        callback_ops{},
+        free_callback_ops{nullptr},
+        queue_send_ops{},
+        free_queue_send_ops{nullptr},
+        zerocopy_chains{} {
+    if (this->wakeup_fd < 0) {
+        throw error::get_error_code_from_errno(errno);
+    }
+
+    //The kernel caps the table at RLIMIT_NOFILE
+    ::rlimit limit{};
+    if (::getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return;
+    }
+    const auto slots = static_cast<unsigned int>(
+            std::min<::rlim_t>(limit.rlim_cur, MAX_FIXED_FILES));
+    if (slots < 2 || ::io_uring_register_files_sparse(this->uring.get(), slots) != 0) {
+        //Older kernel or no room, everything keeps working on plain fds
+        return;
+    }
+    const unsigned int add_slots = slots / 2;
+    if (::io_uring_register_file_alloc_range(this->uring.get(), add_slots, slots - add_slots)
+            != 0) {
+        //Direct descriptors could land anywhere, so add() can't safely hand out slots
+        ::io_uring_unregister_files(this->uring.get());
+        return;
+    }
+    this->fixed_slots = add_slots;
+    this->free_slots.reserve(add_slots);
+    //Reversed so the lowest slots are handed out first
+    for (unsigned int slot = add_slots; slot > 0; --slot) {
+        this->free_slots.push_back(slot - 1);
+    }
+}
+
+[[nodiscard]] auto Executor::add(Handle fd) noexcept -> const std::expected<void, error::ErrorCode> {
+    if (fd < 0) {
+        return std::unexpected(error::get_error_code_from_errno(EBADF));
+    }
+    if (this->free_slots.empty()) {
+        //Table full (or unsupported), the fd still works without IOSQE_FIXED_FILE
+        return {};
+    }
+    try {
+        if (static_cast<size_t>(fd) >= this->fixed_index.size()) {
+            this->fixed_index.resize(fd + 1, -1);
+        }
+    } catch (const std::bad_alloc&) {
+        return std::unexpected(error::get_error_code_from_errno(ENOMEM));
+    }
+    if (this->fixed_index[fd] >= 0) {
+        return std::unexpected(error::get_error_code_from_errno(EEXIST));
+    }
+
+    const auto slot = this->free_slots.back();
+    const auto ret = ::io_uring_register_files_update(this->uring.get(), slot, &fd, 1);
+    if (ret < 0) {
+        return std::unexpected(error::get_error_code_from_errno(-ret));
+    }
+    this->free_slots.pop_back();
+    this->fixed_index[fd] = static_cast<int>(slot);
+    return {};
+}
+
+[[nodiscard]] auto Executor::remove(Handle fd) noexcept
+        -> const std::expected<void, error::ErrorCode> {
+    const auto file = this->target(fd);
+    if (!file.fixed) {
+        //Never made it into the table, nothing to release
+        return {};
+    }
+    if (const auto res = this->close_direct(file); !res.has_value()) {
+        return res;
+    }
+    this->fixed_index[fd] = -1;
+    //free_slots was reserved for every slot up front, so this can't allocate
+    this->free_slots.push_back(static_cast<unsigned int>(file.index));
+    return {};
+}
+
+[[nodiscard]] auto Executor::close_direct(const file_ref file) noexcept
+        -> const std::expected<void, error::ErrorCode> {
+    if (!file.fixed) {
+        return std::unexpected(error::get_error_code_from_errno(EBADF));
+    }
+    const int empty = -1;
+    const auto ret = ::io_uring_register_files_update(
+            this->uring.get(), static_cast<unsigned int>(file.index), &empty, 1);
+    if (ret < 0) {
+        return std::unexpected(error::get_error_code_from_errno(-ret));
+    }
+    return {};
+}
+
+[[nodiscard]] accept_direct_awaitable Executor::accept_direct(
+        Handle listener, const int flags) noexcept {
+    return accept_direct_awaitable{*this, this->target(listener), flags & ~SOCK_CLOEXEC};
+}
+
+bool accept_direct_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        this->res = -EBUSY;
+        return false;
+    }
+    ::io_uring_prep_accept_direct(sqe,
+            this->listener.index,
+            reinterpret_cast<::sockaddr *>(&this->addr),
+            &this->addr_len,
+            this->accept_flags,
+            IORING_FILE_INDEX_ALLOC);
+    this->listener.apply(*sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(this));
+    this->waiter = h;
+    return true;
+}
+
+[[nodiscard]] ::io_uring_sqe *Executor::get_sqe() noexcept {
+    auto *sqe = ::io_uring_get_sqe(this->uring.get());
+    if (sqe) {
+        return sqe;
+    }
+    //Ring is full, flush what's queued now rather than failing the operation
+    ::io_uring_submit(this->uring.get());
+    return ::io_uring_get_sqe(this->uring.get());
+}
+
+[[nodiscard]] Executor::callback_operation& Executor::acquire_callback_op(result_callback&& cb) {
+    callback_operation *op = this->free_callback_ops;
+    if (op) {
+        this->free_callback_ops = op->next_free;
+    } else {
+        op = &this->callback_ops.emplace_back();
+    }
+    op->on_complete = &Executor::complete_callback_op;
+    op->owner = this;
+    op->cb.emplace(std::move(cb));
+    op->next_free = nullptr;
+    return *op;
+}
+
+void Executor::release_callback_op(callback_operation& op) noexcept {
+    op.cb.reset();
+    op.next_free = this->free_callback_ops;
+    this->free_callback_ops = &op;
+}
+
+[[nodiscard]] Executor::queue_send_operation& Executor::acquire_queue_send_op(
+        BufferQueue& queue, result_callback&& cb) {
+    queue_send_operation *op = this->free_queue_send_ops;
+    if (op) {
+        this->free_queue_send_ops = op->next_free;
+    } else {
+        op = &this->queue_send_ops.emplace_back();
+    }
+    op->on_complete = &Executor::complete_queue_send_op;
+    op->owner = this;
+    op->queue = &queue;
+    op->cb.emplace(std::move(cb));
+    op->next_zerocopy = nullptr;
+    op->zerocopy = false;
+    op->notified = false;
+    op->next_free = nullptr;
+    return *op;
+}
+
+void Executor::release_queue_send_op(queue_send_operation& op) noexcept {
+    op.queue = nullptr;
+    op.cb.reset();
+    //clear() keeps the capacity around for the next zero-copy send
+    op.released.clear();
+    op.next_free = this->free_queue_send_ops;
+    this->free_queue_send_ops = &op;
+}
+
+[[nodiscard]] Executor::queue_send_operation *Executor::zerocopy_tail(
+        const BufferQueue& queue) noexcept {
+    const auto it = this->zerocopy_chains.find(&queue);
+    return it == this->zerocopy_chains.end() ? nullptr : it->second.tail;
+}
+
+void Executor::retire_zerocopy(const BufferQueue& queue) noexcept {
+    const auto it = this->zerocopy_chains.find(&queue);
+    assert(it != this->zerocopy_chains.end());
+    auto& chain = it->second;
+
+    //Unlink everything retirable first, the callbacks may start new sends on this queue
+    queue_send_operation *done = nullptr;
+    queue_send_operation **done_tail = &done;
+    while (chain.head && chain.head->notified) {
+        auto *const op = std::exchange(chain.head, chain.head->next_zerocopy);
+        op->next_zerocopy = nullptr;
+        *done_tail = op;
+        done_tail = &op->next_zerocopy;
+    }
+    if (!chain.head) {
+        this->zerocopy_chains.erase(it);
+    }
+
+    while (done) {
+        auto *const op = std::exchange(done, done->next_zerocopy);
+        for (auto& cb : op->released) {
+            std::move(cb)();
+        }
+        this->release_queue_send_op(*op);
+    }
+}
+
+void Executor::complete_queue_send_op(operation *op, const ::io_uring_cqe& cqe) noexcept {
+    auto *const self = static_cast<queue_send_operation *>(op);
+    auto& owner = *self->owner;
+    const auto& queue = *self->queue;
+
+    if (cqe.flags & IORING_CQE_F_NOTIF) {
+        //The kernel has let go of the pages, the buffers go once every older send has too
+        self->notified = true;
+        owner.retire_zerocopy(queue);
+        return;
+    }
+
+    if (cqe.res > 0) {
+        const auto sent = static_cast<size_t>(cqe.res);
+        if (auto *const parked = owner.zerocopy_tail(queue)) {
+            //send_queue reserved room for every callback this send can pop
+            self->queue->pop(sent, [parked](n3::callback<void>&& cb) noexcept {
+                parked->released.push_back(std::move(cb));
+            });
+        } else {
+            self->queue->pop(sent);
+        }
+    }
+
+    auto cb = std::move(*self->cb);
+    self->cb.reset();
+    if (!self->zerocopy) {
+        owner.release_queue_send_op(*self);
+    } else if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        //No F_MORE on the send CQE means no notification follows, the pages were never pinned
+        self->notified = true;
+        owner.retire_zerocopy(queue);
+    }
+    std::move(cb)(to_result(cqe.res));
+}
+
+void Executor::send_queue(
+        const file_ref file, BufferQueue& queue, const int flags, result_callback&& cb) {
+    if (queue.empty()) {
+        std::move(cb)(0);
+        return;
+    }
+    const auto buf = queue.front();
+    const bool zerocopy = (buf.size() >= ZEROCOPY_THRESHOLD);
+
+    /*
+     * Everything that can allocate happens before an SQE is taken
+     * A send only covers the front buffer, so it pops that one's callback plus those of any empty
+     * buffers right behind it, room for them is made on whichever send they get parked on
+     */
+    const auto releasable = 1
+            + std::ranges::distance(queue.pending() | std::views::drop(1)
+                    | std::views::take_while([](const RefBuffer pending_buf) noexcept {
+                          return pending_buf.empty();
+                      }));
+    auto& op = this->acquire_queue_send_op(queue, std::move(cb));
+    try {
+        if (zerocopy) {
+            op.released.reserve(static_cast<size_t>(releasable));
+            this->zerocopy_chains.try_emplace(&queue, zerocopy_chain{nullptr, nullptr});
+        } else if (auto *const parked = this->zerocopy_tail(queue)) {
+            parked->released.reserve(parked->released.size() + static_cast<size_t>(releasable));
+        }
+    } catch (...) {
+        this->release_queue_send_op(op);
+        throw;
+    }
+
+    auto *const sqe = this->get_sqe();
+    if (!sqe) {
+        auto failed = std::move(*op.cb);
+        this->release_queue_send_op(op);
+        if (const auto it = this->zerocopy_chains.find(&queue);
+                it != this->zerocopy_chains.end() && !it->second.head) {
+            this->zerocopy_chains.erase(it);
+        }
+        std::move(failed)(std::unexpected(error::get_error_code_from_errno(EBUSY)));
+        return;
+    }
+
+    if (zerocopy) {
+        op.zerocopy = true;
+        auto& chain = this->zerocopy_chains.find(&queue)->second;
+        (chain.tail ? chain.tail->next_zerocopy : chain.head) = &op;
+        chain.tail = &op;
+        ::io_uring_prep_send_zc(sqe, file.index, buf.data(), buf.size(), flags, 0);
+    } else {
+        //Below the threshold, pinning pages and the extra CQE cost more than the copy
+        ::io_uring_prep_send(sqe, file.index, buf.data(), buf.size(), flags);
+    }
+    file.apply(*sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(&op));
+}
+
+void Executor::complete_callback_op(operation *op, const ::io_uring_cqe& cqe) noexcept {
+    auto *const self = static_cast<callback_operation *>(op);
+    //Move the callback out first, so the op is recycled before user code gets to submit more
+    auto cb = std::move(*self->cb);
+    self->owner->release_callback_op(*self);
+    std::move(cb)(to_result(cqe.res));
+}
+
+void Executor::submit_callback(result_callback&& cb, auto&& prep) {
+    auto *const sqe = this->get_sqe();
+    if (!sqe) {
+        std::move(cb)(std::unexpected(error::get_error_code_from_errno(EBUSY)));
+        return;
+    }
+    auto& op = this->acquire_callback_op(std::move(cb));
+    prep(*sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(&op));
+}
+
+void Executor::recv(Handle fd, RefBuffer buf, const int flags, result_callback&& cb) {
+    const auto file = this->target(fd);
+    this->submit_callback(std::move(cb), [=](::io_uring_sqe& sqe) noexcept {
+        ::io_uring_prep_recv(&sqe, file.index, buf.data(), buf.size(), flags);
+        file.apply(sqe);
+    });
+}
+
+void Executor::send(Handle fd, RefBuffer buf, const int flags, result_callback&& cb) {
+    const auto file = this->target(fd);
+    this->submit_callback(std::move(cb), [=](::io_uring_sqe& sqe) noexcept {
+        ::io_uring_prep_send(&sqe, file.index, buf.data(), buf.size(), flags);
+        file.apply(sqe);
+    });
+}
+
+unsigned int Executor::reap() noexcept {
+    auto *const ring = this->uring.get();
+    unsigned int head = 0;
+    unsigned int count = 0;
+    ::io_uring_cqe *cqe = nullptr;
+
+    io_uring_for_each_cqe(ring, head, cqe) {
+        ++count;
+        auto *const op = static_cast<operation *>(::io_uring_cqe_get_data(cqe));
+        //Null user_data is used for fire-and-forget SQEs nobody waits on
+        if (!op) {
+            continue;
+        }
+        op->on_complete(op, *cqe);
+    }
+    //One store to the CQ head for the whole batch instead of one per CQE
+    ::io_uring_cq_advance(ring, count);
+    return count;
+}
+
+void Executor::complete_wakeup(operation *op, const ::io_uring_cqe&) noexcept {
+    auto *const self = static_cast<wakeup_operation *>(op);
+    uint64_t count = 0;
+    [[maybe_unused]] const auto _ = ::read(self->owner->wakeup_fd, &count, sizeof(count));
+    //Whatever the result, the next run_once puts a new poll in flight
+    self->armed = false;
+}
+
+void Executor::arm_wakeup() noexcept {
+    if (this->wakeup_op.armed) {
+        return;
+    }
+    auto *const sqe = this->get_sqe();
+    if (!sqe) {
+        //Tried again next iteration, until then a wake() only lands once something else completes
+        return;
+    }
+    ::io_uring_prep_poll_add(sqe, this->wakeup_fd, POLLIN);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(&this->wakeup_op));
+    this->wakeup_op.armed = true;
+}
+
+void Executor::run_once() {
+    this->arm_wakeup();
+
+    //Submits everything queued since the last iteration and waits for a completion, in one syscall
+    const auto ret = ::io_uring_submit_and_wait(this->uring.get(), 1);
+    //EBUSY means the CQ overflowed, reaping below is exactly what makes room again
+    if (ret < 0 && ret != -EINTR && ret != -ETIME && ret != -EBUSY) {
+        throw error::get_error_code_from_errno(-ret);
+    }
+    this->reap();
+}
+
+void Executor::run() {
+    while (this->is_active()) {
+        this->run_once();
+    }
+}
+
+void Executor::stop() noexcept {
+    this->active.store(false, std::memory_order_release);
+    this->wake();
+}
+
+void Executor::wake() noexcept {
+    const uint64_t one = 1;
+    //EAGAIN means the counter is saturated, which still leaves a wakeup pending
+    [[maybe_unused]] const auto _ = ::write(this->wakeup_fd, &one, sizeof(one));
+}
+
 } // namespace n3::linux::io_uring
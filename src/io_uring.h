@@ -1,23 +1,71 @@
 #pragma once
 
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
 #include <exception>
 #include <expected>
+#include <functional>
 #include <liburing.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
 
+#include "address.h"
 #include "buffer.h"
+#include "callbacks.h"
 #include "error.h"
+#include "frame_allocator.h"
 #include "handle.h"
 #include "ownership.h"
+#include "syscalls.h"
 
 namespace n3::linux::io_uring {
 
+enum class ring_mode {
+    //Kernel thread polls the SQ, submissions skip io_uring_enter entirely but it costs a core
+    sqpoll,
+    //Completion work only runs when the owning thread waits, so it's batched and never preempts
+    defer_taskrun,
+    //No special setup flags, works on every kernel the executor supports
+    plain,
+};
+
+//Ring setup policy, modes that the kernel rejects fall back to the next cheaper one in the list
+struct ring_config {
+    ring_mode mode{ring_mode::defer_taskrun};
+    //If false, failing to set up the requested mode throws instead of falling back
+    bool fallback{true};
+
+    unsigned int sq_entries{1024};
+    unsigned int cq_entries{32768};
+
+    //SQPOLL only, how long the poller spins without work before it sleeps
+    std::chrono::milliseconds sq_idle{1000};
+    //SQPOLL only, pins the poller thread to a CPU
+    std::optional<unsigned int> sq_cpu{};
+};
+
 class io_uring_handle {
     MoveOnly<::io_uring> ring;
+    ring_mode active_mode;
 
 public:
-    io_uring_handle();
+    explicit io_uring_handle(const ring_config& config = {});
     ~io_uring_handle();
 
+    //The mode that was actually set up, after any fallback
+    [[nodiscard]] ring_mode mode() const noexcept {
+        return this->active_mode;
+    }
+
     constexpr const ::io_uring *get() const noexcept {
         return &*ring;
     }
@@ -29,31 +77,926 @@ public:
 [[nodiscard]] std::optional<std::reference_wrapper<::io_uring_sqe>> get_sqe(
         io_uring_handle& handle) noexcept;
 
+//Converts a CQE result into the usual syscall wrapper return type
+[[nodiscard]] constexpr std::expected<size_t, error::ErrorCode> to_result(const int res) noexcept {
+    if (res < 0) {
+        return std::unexpected(error::get_error_code_from_errno(-res));
+    }
+    return static_cast<size_t>(res);
+}
+
+/*
+ * Base of every in-flight operation, its address is what goes into the SQE user_data
+ * Completions are routed through a plain function pointer instead of a virtual call, the
+ * concrete operation type is always known at the point where it's submitted
+ */
+struct operation {
+    using complete_fn = void (*)(operation *, const ::io_uring_cqe&) noexcept;
+
+    complete_fn on_complete;
+};
+
+/*
+ * Target of an SQE, either a plain fd or a slot in the registered (fixed) file table
+ * Fixed files skip the fget/fput, and its atomic refcount, on the file for every operation
+ */
+struct file_ref {
+    int index;
+    bool fixed;
+
+    //Direct descriptors from accept_direct() only exist as a slot in the file table
+    [[nodiscard]] static constexpr file_ref direct(const unsigned int slot) noexcept {
+        return {static_cast<int>(slot), true};
+    }
+
+    //Must run after the io_uring_prep_* call, those reset the SQE flags
+    void apply(::io_uring_sqe& sqe) const noexcept {
+        if (this->fixed) {
+            sqe.flags |= IOSQE_FIXED_FILE;
+        }
+    }
+};
+
+using peer_address = std::variant<n3::net::v4::address, n3::net::v6::address>;
+
+/*
+ * Connection handed out by multishot_accept
+ * The kernel can't report a peer address per CQE, so it's only looked up (with getpeername) for
+ * callers that ask, most servers never need it on the accept path
+ */
+struct accepted_socket {
+    Handle fd;
+
+    [[nodiscard]] std::expected<peer_address, error::ErrorCode> peer() const noexcept {
+        return n3::linux::getpeername(this->fd);
+    }
+};
+
+class Executor;
+class buffer_ring;
+class queue_send_awaitable;
+
+/*
+ * Borrowed view of a kernel selected provided buffer
+ * Move only, the buffer ID goes back to its ring when the view is released or destroyed
+ * A default constructed (or EOF) view is empty and owns nothing
+ */
+class provided_buffer {
+    buffer_ring *owner;
+    uint16_t bid;
+    size_t len;
+
+public:
+    constexpr provided_buffer() noexcept : owner{nullptr}, bid{0}, len{0} {
+    }
+    provided_buffer(buffer_ring& ring, const uint16_t buffer_id, const size_t length) noexcept :
+            owner{&ring},
+            bid{buffer_id},
+            len{length} {
+    }
+    ~provided_buffer() {
+        this->release();
+    }
+
+    provided_buffer(const provided_buffer&) = delete;
+    provided_buffer(provided_buffer&& other) noexcept :
+            owner{std::exchange(other.owner, nullptr)},
+            bid{other.bid},
+            len{std::exchange(other.len, 0)} {
+    }
+
+    provided_buffer& operator=(const provided_buffer&) = delete;
+    provided_buffer& operator=(provided_buffer&& other) noexcept {
+        if (this != &other) {
+            this->release();
+            this->owner = std::exchange(other.owner, nullptr);
+            this->bid = other.bid;
+            this->len = std::exchange(other.len, 0);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return this->len == 0;
+    }
+    [[nodiscard]] size_t size() const noexcept {
+        return this->len;
+    }
+    //Only valid until the view is released
+    [[nodiscard]] std::span<std::byte> data() const noexcept;
+
+    //Hands the buffer back to the kernel early
+    void release() noexcept;
+};
+
+//Deleter for memory from the aligned operator new[], which has to go back with the same alignment
+struct aligned_delete {
+    size_t alignment;
+    void operator()(std::byte *ptr) const noexcept {
+        ::operator delete[](ptr, static_cast<std::align_val_t>(this->alignment));
+    }
+};
+
+/*
+ * Registered provided buffer ring (io_uring_setup_buf_ring)
+ *
+ * One pool of equal sized receive buffers shared by every operation that selects from its group
+ * The kernel picks a free buffer only when data actually arrives, so idle sockets don't pin any
+ * receive memory and no per-read buffer has to be supplied up front
+ */
+class buffer_ring {
+    ::io_uring *ring;
+    ::io_uring_buf_ring *br;
+    std::unique_ptr<std::byte[], aligned_delete> storage;
+    const uint16_t group_id;
+    const uint16_t entries;
+    const size_t buffer_size;
+
+public:
+    //Entries must be a power of two, throws on registration failure
+    buffer_ring(io_uring_handle& handle,
+            const uint16_t group,
+            const uint16_t entry_count,
+            const size_t buf_size);
+    ~buffer_ring();
+
+    buffer_ring(const buffer_ring&) = delete;
+    buffer_ring& operator=(const buffer_ring&) = delete;
+
+    [[nodiscard]] uint16_t group() const noexcept {
+        return this->group_id;
+    }
+    [[nodiscard]] uint16_t size() const noexcept {
+        return this->entries;
+    }
+    [[nodiscard]] std::span<std::byte> buffer(const uint16_t bid) const noexcept {
+        assert(bid < this->entries);
+        return {this->storage.get() + (bid * this->buffer_size), this->buffer_size};
+    }
+
+    //Makes the buffer available for the kernel to select again
+    void recycle(const uint16_t bid) noexcept;
+};
+
+inline std::span<std::byte> provided_buffer::data() const noexcept {
+    if (!this->owner) {
+        return {};
+    }
+    return this->owner->buffer(this->bid).first(this->len);
+}
+
+inline void provided_buffer::release() noexcept {
+    if (this->owner) {
+        std::exchange(this->owner, nullptr)->recycle(this->bid);
+        this->len = 0;
+    }
+}
+
+class registered_buffer_pool;
+
+//Byte range inside a registered buffer, tagged with the buffer's registration index
+struct fixed_slice {
+    RefBuffer buf;
+    uint16_t index;
+};
+
+/*
+ * Lease on one slab of a registered_buffer_pool
+ * Move only, the slab goes back to the pool when the lease is released or destroyed
+ */
+class fixed_buffer {
+    registered_buffer_pool *owner;
+    uint16_t idx;
+
+public:
+    constexpr fixed_buffer() noexcept : owner{nullptr}, idx{0} {
+    }
+    fixed_buffer(registered_buffer_pool& pool, const uint16_t index) noexcept :
+            owner{&pool},
+            idx{index} {
+    }
+    ~fixed_buffer() {
+        this->release();
+    }
+
+    fixed_buffer(const fixed_buffer&) = delete;
+    fixed_buffer(fixed_buffer&& other) noexcept :
+            owner{std::exchange(other.owner, nullptr)},
+            idx{other.idx} {
+    }
+
+    fixed_buffer& operator=(const fixed_buffer&) = delete;
+    fixed_buffer& operator=(fixed_buffer&& other) noexcept {
+        if (this != &other) {
+            this->release();
+            this->owner = std::exchange(other.owner, nullptr);
+            this->idx = other.idx;
+        }
+        return *this;
+    }
+
+    [[nodiscard]] uint16_t index() const noexcept {
+        return this->idx;
+    }
+    [[nodiscard]] std::span<std::byte> data() const noexcept;
+
+    [[nodiscard]] fixed_slice slice(const size_t offset, const size_t len) const noexcept {
+        assert(offset + len <= this->data().size());
+        return {RefBuffer{this->data().subspan(offset, len)}, this->idx};
+    }
+    [[nodiscard]] operator fixed_slice() const noexcept {
+        return {RefBuffer{this->data()}, this->idx};
+    }
+
+    void release() noexcept;
+};
+
+/*
+ * Pool of page aligned slabs registered with io_uring_register_buffers
+ *
+ * The kernel pins and maps the pages once at registration, so the fixed buffer operations skip
+ * the per-operation page pinning that a plain read/write/send pays for every call
+ * A ring only has one registered buffer table, so there can be one pool per Executor
+ */
+class registered_buffer_pool {
+    ::io_uring *ring;
+    std::unique_ptr<std::byte[], aligned_delete> storage;
+    const uint16_t count;
+    const size_t slab_size;
+    std::vector<uint16_t> free_slabs;
+
+public:
+    //Slab size must be a multiple of the page size, throws on registration failure
+    registered_buffer_pool(
+            io_uring_handle& handle, const uint16_t slab_count, const size_t slab_bytes);
+    ~registered_buffer_pool();
+
+    registered_buffer_pool(const registered_buffer_pool&) = delete;
+    registered_buffer_pool& operator=(const registered_buffer_pool&) = delete;
+
+    //Empty if every slab is leased out
+    [[nodiscard]] std::optional<fixed_buffer> acquire() noexcept {
+        if (this->free_slabs.empty()) {
+            return std::nullopt;
+        }
+        const auto index = this->free_slabs.back();
+        this->free_slabs.pop_back();
+        return std::optional<fixed_buffer>{std::in_place, *this, index};
+    }
+    [[nodiscard]] size_t available() const noexcept {
+        return this->free_slabs.size();
+    }
+    [[nodiscard]] std::span<std::byte> slab(const uint16_t index) const noexcept {
+        assert(index < this->count);
+        return {this->storage.get() + (index * this->slab_size), this->slab_size};
+    }
+
+    void recycle(const uint16_t index) noexcept {
+        //Reserved for every slab up front, so this can't allocate
+        this->free_slabs.push_back(index);
+    }
+};
+
+inline std::span<std::byte> fixed_buffer::data() const noexcept {
+    if (!this->owner) {
+        return {};
+    }
+    return this->owner->slab(this->idx);
+}
+
+inline void fixed_buffer::release() noexcept {
+    if (this->owner) {
+        std::exchange(this->owner, nullptr)->recycle(this->idx);
+    }
+}
+
+/*
+ * Awaitable for a single shot operation
+ * Prep fills out the SQE, and the awaitable itself is the operation, so it lives in the
+ * coroutine frame and submitting doesn't allocate
+ * The SQE is only queued here, it goes to the kernel with everything else on the next run_once()
+ */
+template<typename Prep>
+class UringAwaitable : public operation {
+    Executor& exec;
+    Prep prep;
+    std::coroutine_handle<> waiter;
+    int res;
+
+    static void complete(operation *op, const ::io_uring_cqe& cqe) noexcept {
+        auto *const self = static_cast<UringAwaitable *>(op);
+        self->res = cqe.res;
+        self->waiter.resume();
+    }
+
+public:
+    UringAwaitable(Executor& executor, Prep&& prep_func) noexcept :
+            operation{&UringAwaitable::complete},
+            exec{executor},
+            prep{std::move(prep_func)},
+            waiter{},
+            res{0} {
+    }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+    //Defined after Executor, returns false to resume straight away if there's no SQE available
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    [[nodiscard]] std::expected<size_t, error::ErrorCode> await_resume() const noexcept {
+        return to_result(this->res);
+    }
+};
+
+/*
+ * Zero-copy send from a registered buffer (IORING_OP_SEND_ZC with IORING_RECVSEND_FIXED_BUF)
+ * A zero-copy send completes twice, the awaitable only resumes on the notification CQE so the
+ * buffer is safe to reuse by the time the coroutine sees the send result
+ */
+class fixed_send_awaitable : public operation {
+    Executor& exec;
+    const file_ref file;
+    const fixed_slice buf;
+    const int flags;
+    std::coroutine_handle<> waiter;
+    int res;
+
+    static void complete(operation *op, const ::io_uring_cqe& cqe) noexcept {
+        auto *const self = static_cast<fixed_send_awaitable *>(op);
+        if (!(cqe.flags & IORING_CQE_F_NOTIF)) {
+            self->res = cqe.res;
+        }
+        if (cqe.flags & IORING_CQE_F_MORE) {
+            //The notification for this send is still to come
+            return;
+        }
+        self->waiter.resume();
+    }
+
+public:
+    fixed_send_awaitable(Executor& executor,
+            const file_ref target,
+            const fixed_slice slice,
+            const int send_flags) noexcept :
+            operation{&fixed_send_awaitable::complete},
+            exec{executor},
+            file{target},
+            buf{slice},
+            flags{send_flags},
+            waiter{},
+            res{0} {
+    }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    [[nodiscard]] std::expected<size_t, error::ErrorCode> await_resume() const noexcept {
+        return to_result(this->res);
+    }
+};
+
+/*
+ * Single shot accept that installs the connection as a direct descriptor
+ * The kernel picks a free slot from the direct descriptor range, the result is a file_ref to it
+ * Unlike multishot accept the kernel fills in the peer address, since there's one per SQE
+ */
+class accept_direct_awaitable : public operation {
+    Executor& exec;
+    const file_ref listener;
+    const int accept_flags;
+    ::sockaddr_storage addr;
+    ::socklen_t addr_len;
+    std::coroutine_handle<> waiter;
+    int res;
+
+    static void complete(operation *op, const ::io_uring_cqe& cqe) noexcept {
+        auto *const self = static_cast<accept_direct_awaitable *>(op);
+        self->res = cqe.res;
+        self->waiter.resume();
+    }
+
+public:
+    accept_direct_awaitable(Executor& executor, const file_ref sock, const int flags) noexcept :
+            operation{&accept_direct_awaitable::complete},
+            exec{executor},
+            listener{sock},
+            accept_flags{flags},
+            addr{},
+            addr_len{sizeof(addr)},
+            waiter{},
+            res{0} {
+    }
+
+    //The kernel writes the peer address into this object, so it can't move once submitted
+    accept_direct_awaitable(const accept_direct_awaitable&) = delete;
+    accept_direct_awaitable& operator=(const accept_direct_awaitable&) = delete;
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    [[nodiscard]] std::expected<std::pair<file_ref, peer_address>, error::ErrorCode>
+            await_resume() const noexcept {
+        if (this->res < 0) {
+            return std::unexpected(error::get_error_code_from_errno(-this->res));
+        }
+        return std::pair{file_ref::direct(this->res), n3::net::sockaddr_to_address(this->addr)};
+    }
+};
+
+/*
+ * Proactor style executor on top of io_uring
+ *
+ * Operations only queue SQEs, and each run_once() does a single io_uring_enter that both
+ * submits everything queued since the last iteration and waits for completions
+ * CQEs are then reaped in one batch and routed to their callback or coroutine through user_data
+ */
 class Executor {
+    using result_callback = n3::callback<std::expected<size_t, error::ErrorCode>>;
+
+    //Pooled operation for the callback based API, so callback submissions don't allocate either
+    struct callback_operation : operation {
+        Executor *owner;
+        std::optional<result_callback> cb;
+        callback_operation *next_free;
+    };
+
     io_uring_handle uring;
-    bool active;
+    //Cleared by stop(), which may be called from any thread
+    std::atomic<bool> active;
+
+    /*
+     * eventfd used to interrupt a blocked run_once from other threads
+     * A poll on it is kept in flight, so a write completes it and io_uring_enter returns
+     * Only re-armed from run_once, the completion handler can't count on a free SQE
+     */
+    struct wakeup_operation : operation {
+        Executor *owner;
+        bool armed;
+    };
+    const OwnedHandle wakeup_fd;
+    wakeup_operation wakeup_op;
+
+    static void complete_wakeup(operation *op, const ::io_uring_cqe& cqe) noexcept;
+    void arm_wakeup() noexcept;
+
+    /*
+     * Sparse registered file table
+     * The lower half is handed out by add(), the upper half is left to the kernel for direct
+     * descriptors (IORING_FILE_INDEX_ALLOC), fixed_slots is 0 if registration isn't supported
+     */
+    unsigned int fixed_slots;
+    //Indexed by fd, -1 if the fd isn't registered
+    std::vector<int> fixed_index;
+    std::vector<unsigned int> free_slots;
+
+    //Deque for stable addresses, entries are recycled through the free list and never released
+    std::deque<callback_operation> callback_ops;
+    callback_operation *free_callback_ops;
+
+    /*
+     * Pooled operation for BufferQueue sends
+     * For zero-copy sends it outlives the send CQE, holding the consumed buffers' callbacks until
+     * the notification CQE says the kernel has stopped referencing the pages
+     */
+    struct queue_send_operation : operation {
+        Executor *owner;
+        BufferQueue *queue;
+        std::optional<result_callback> cb;
+        std::vector<n3::callback<void>> released;
+        //Next younger zero-copy send on the same queue
+        queue_send_operation *next_zerocopy;
+        bool zerocopy;
+        bool notified;
+        queue_send_operation *next_free;
+    };
+
+    std::deque<queue_send_operation> queue_send_ops;
+    queue_send_operation *free_queue_send_ops;
+
+    /*
+     * Zero-copy sends of one queue still waiting for their notification, oldest first
+     * A buffer can be covered by several sends, a partial one and whatever sends the rest, and
+     * notifications can arrive out of order, so sends are retired strictly in submission order
+     * Callbacks popped while a send is outstanding are parked on the youngest one, which makes
+     * them wait for every send that could still reference their pages
+     */
+    struct zerocopy_chain {
+        queue_send_operation *head;
+        queue_send_operation *tail;
+    };
+    std::unordered_map<const BufferQueue *, zerocopy_chain> zerocopy_chains;
+
+    [[nodiscard]] queue_send_operation *zerocopy_tail(const BufferQueue& queue) noexcept;
+    void retire_zerocopy(const BufferQueue& queue) noexcept;
 
-    //std::unordered_map<Handle, epoll_handle_state> handle_map;
+    [[nodiscard]] callback_operation& acquire_callback_op(result_callback&& cb);
+    void release_callback_op(callback_operation& op) noexcept;
+    [[nodiscard]] queue_send_operation& acquire_queue_send_op(
+            BufferQueue& queue, result_callback&& cb);
+    void release_queue_send_op(queue_send_operation& op) noexcept;
+    static void complete_queue_send_op(operation *op, const ::io_uring_cqe& cqe) noexcept;
+    static void complete_callback_op(operation *op, const ::io_uring_cqe& cqe) noexcept;
+    void submit_callback(result_callback&& cb, auto&& prep);
 
-    std::vector<Handle> handles;
+    //Dispatches every CQE currently in the completion ring, returns how many there were
+    unsigned int reap() noexcept;
 
 public:
-    Executor();
+    explicit Executor(const ring_config& config = {});
 
+    /*
+     * Registers the fd in the fixed file table, operations on it then use IOSQE_FIXED_FILE
+     * If the table is full or unsupported the fd is still usable, just as a plain fd
+     * remove() must be called before the fd is closed, the table holds its own file reference
+     */
     [[nodiscard]] auto add(Handle fd) noexcept -> const std::expected<void, error::ErrorCode>;
     [[nodiscard]] auto remove(Handle fd) noexcept -> const std::expected<void, error::ErrorCode>;
 
+    //Resolves an fd to its fixed file slot if it has one
+    [[nodiscard]] file_ref target(const Handle fd) const noexcept {
+        if (fd >= 0 && static_cast<size_t>(fd) < this->fixed_index.size()
+                && this->fixed_index[fd] >= 0) {
+            return {this->fixed_index[fd], true};
+        }
+        return {fd, false};
+    }
+
+    //Releases a direct descriptor's slot, which closes it if nothing else references the file
+    [[nodiscard]] auto close_direct(const file_ref file) noexcept
+            -> const std::expected<void, error::ErrorCode>;
+
+    /*
+     * Returns a free SQE for an operation to fill out
+     * If the submission ring is full, everything queued so far is submitted early to make room
+     */
+    [[nodiscard]] ::io_uring_sqe *get_sqe() noexcept;
+
+    [[nodiscard]] io_uring_handle& ring() noexcept {
+        return this->uring;
+    }
+
     /*
      * TODO: Need a few more functions
-     *  - Run (main loop invocation, may want a run_once split off)
      *  - Registering read/write events and callbacks (Done in an init function, or per-call?)
      *  - Memory buffer to handle data reads that we can return to the user
      */
+    //Runs until stop() is called, a stop before run() makes it return immediately
     void run();
+    //Throws the error code if io_uring_enter fails for anything but an interrupted or busy wait
     void run_once();
     void run_until();
+
+    //Thread safe, both interrupt a blocked run_once from any thread
+    void stop() noexcept;
+    void wake() noexcept;
+    [[nodiscard]] bool is_active() const noexcept {
+        return this->active.load(std::memory_order_acquire);
+    }
+
+    //Coroutine operations, co_await the result to get the CQE result as a byte count or error
+    [[nodiscard]] auto recv(const file_ref file, RefBuffer buf, const int flags = 0) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_recv(
+                                          &sqe, file.index, buf.data(), buf.size(), flags);
+                                  file.apply(sqe);
+                              }};
+    }
+    [[nodiscard]] auto send(const file_ref file, RefBuffer buf, const int flags = 0) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_send(
+                                          &sqe, file.index, buf.data(), buf.size(), flags);
+                                  file.apply(sqe);
+                              }};
+    }
+    [[nodiscard]] auto read(
+            const file_ref file, RefBuffer buf, const uint64_t offset = -1) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_read(
+                                          &sqe, file.index, buf.data(), buf.size(), offset);
+                                  file.apply(sqe);
+                              }};
+    }
+    [[nodiscard]] auto write(
+            const file_ref file, RefBuffer buf, const uint64_t offset = -1) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_write(
+                                          &sqe, file.index, buf.data(), buf.size(), offset);
+                                  file.apply(sqe);
+                              }};
+    }
+
+    //Plain fd overloads, the fd is swapped for its fixed file slot if it was add()ed
+    [[nodiscard]] auto recv(Handle fd, RefBuffer buf, const int flags = 0) noexcept {
+        return this->recv(this->target(fd), buf, flags);
+    }
+    [[nodiscard]] auto send(Handle fd, RefBuffer buf, const int flags = 0) noexcept {
+        return this->send(this->target(fd), buf, flags);
+    }
+    [[nodiscard]] auto read(Handle fd, RefBuffer buf, const uint64_t offset = -1) noexcept {
+        return this->read(this->target(fd), buf, offset);
+    }
+    [[nodiscard]] auto write(Handle fd, RefBuffer buf, const uint64_t offset = -1) noexcept {
+        return this->write(this->target(fd), buf, offset);
+    }
+
+    /*
+     * Fixed buffer operations, the slice has to come from the Executor's registered_buffer_pool
+     * The kernel has no fixed buffer recv, receives use a provided buffer_ring instead
+     */
+    [[nodiscard]] auto read_fixed(
+            const file_ref file, const fixed_slice buf, const uint64_t offset = -1) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_read_fixed(&sqe,
+                                          file.index,
+                                          buf.buf.data(),
+                                          buf.buf.size(),
+                                          offset,
+                                          buf.index);
+                                  file.apply(sqe);
+                              }};
+    }
+    [[nodiscard]] auto write_fixed(
+            const file_ref file, const fixed_slice buf, const uint64_t offset = -1) noexcept {
+        return UringAwaitable{*this, [=](::io_uring_sqe& sqe) noexcept {
+                                  ::io_uring_prep_write_fixed(&sqe,
+                                          file.index,
+                                          buf.buf.data(),
+                                          buf.buf.size(),
+                                          offset,
+                                          buf.index);
+                                  file.apply(sqe);
+                              }};
+    }
+    [[nodiscard]] fixed_send_awaitable send_fixed(
+            const file_ref file, const fixed_slice buf, const int flags = 0) noexcept {
+        return fixed_send_awaitable{*this, file, buf, flags};
+    }
+
+    [[nodiscard]] auto read_fixed(
+            Handle fd, const fixed_slice buf, const uint64_t offset = -1) noexcept {
+        return this->read_fixed(this->target(fd), buf, offset);
+    }
+    [[nodiscard]] auto write_fixed(
+            Handle fd, const fixed_slice buf, const uint64_t offset = -1) noexcept {
+        return this->write_fixed(this->target(fd), buf, offset);
+    }
+    [[nodiscard]] fixed_send_awaitable send_fixed(
+            Handle fd, const fixed_slice buf, const int flags = 0) noexcept {
+        return this->send_fixed(this->target(fd), buf, flags);
+    }
+
+    /*
+     * Accepts straight into the fixed file table, the new connection never gets a regular fd
+     * SOCK_CLOEXEC is dropped from the flags, there's no fd for it to apply to and the kernel
+     * rejects it with EINVAL
+     */
+    [[nodiscard]] accept_direct_awaitable accept_direct(
+            Handle listener, const int flags = 0) noexcept;
+
+    //Callback operations, the callback is invoked from run_once() with the CQE result
+    void recv(Handle fd, RefBuffer buf, const int flags, result_callback&& cb);
+    void send(Handle fd, RefBuffer buf, const int flags, result_callback&& cb);
+
+    //Front buffers at least this big are sent with IORING_OP_SEND_ZC instead of being copied
+    static constexpr size_t ZEROCOPY_THRESHOLD = 16 * 1024;
+
+    /*
+     * Sends from the front of the queue and pops whatever was sent
+     * Large buffers go out zero-copy, and their release callbacks are deferred until the kernel's
+     * notification CQE, so they only fire once the memory can actually be reused
+     * The callback gets the send result as soon as the send itself completes
+     * Only one send per queue may be in flight, and the queue must outlive its notifications
+     */
+    void send_queue(const file_ref file, BufferQueue& queue, const int flags, result_callback&& cb);
+    void send_queue(Handle fd, BufferQueue& queue, const int flags, result_callback&& cb) {
+        this->send_queue(this->target(fd), queue, flags, std::move(cb));
+    }
+    [[nodiscard]] queue_send_awaitable send_queue(
+            Handle fd, BufferQueue& queue, const int flags = 0) noexcept;
+    //A zero-copy send from the queue is still waiting for its notification, so it can't go away
+    [[nodiscard]] bool zerocopy_pending(const BufferQueue& queue) const noexcept {
+        return this->zerocopy_chains.contains(&queue);
+    }
+};
+
+//Coroutine form of Executor::send_queue()
+class queue_send_awaitable {
+    Executor& exec;
+    const file_ref file;
+    BufferQueue& queue;
+    const int flags;
+    std::coroutine_handle<> waiter;
+    std::optional<std::expected<size_t, error::ErrorCode>> result;
+
+public:
+    queue_send_awaitable(Executor& executor,
+            const file_ref target,
+            BufferQueue& buffers,
+            const int send_flags) noexcept :
+            exec{executor},
+            file{target},
+            queue{buffers},
+            flags{send_flags},
+            waiter{},
+            result{} {
+    }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> h) {
+        this->exec.send_queue(this->file, this->queue, this->flags, [this](auto res) {
+            this->result.emplace(std::move(res));
+            if (this->waiter) {
+                this->waiter.resume();
+            }
+        });
+        //Errors before submission complete synchronously, so don't suspend at all
+        if (this->result.has_value()) {
+            return false;
+        }
+        this->waiter = h;
+        return true;
+    }
+    [[nodiscard]] std::expected<size_t, error::ErrorCode> await_resume() noexcept {
+        return std::move(*this->result);
+    }
+};
+
+[[nodiscard]] inline queue_send_awaitable Executor::send_queue(
+        Handle fd, BufferQueue& queue, const int flags) noexcept {
+    return queue_send_awaitable{*this, this->target(fd), queue, flags};
+}
+
+/*
+ * Multishot recv selecting from a provided buffer ring
+ *
+ * One SQE keeps delivering data until it's cancelled, errors out, or the peer closes
+ * Results go to the handler if one was given, otherwise they queue up for co_await next()
+ * EOF is delivered as an empty provided_buffer, and running out of ring buffers ends the stream
+ * with ENOBUFS, start() can re-arm it once buffers have been released
+ *
+ * The queue for next() is allocated up front, every queued item either holds one of the ring's
+ * buffers or is the single final result of an arming, so the ring size plus one bounds it
+ * Without a handler start() only re-arms once that final result has been taken with next()
+ *
+ * The object is the in-flight operation, so it can't move and must not be destroyed while armed
+ * Call cancel() and keep running the executor until is_armed() is false
+ */
+class multishot_recv : public operation {
+public:
+    using item_type = std::expected<provided_buffer, error::ErrorCode>;
+    //Called for every completion, unlike n3::callback this is invoked many times
+    using handler_type = std::move_only_function<void(item_type)>;
+
+private:
+    Executor& exec;
+    const Handle fd;
+    buffer_ring& buffers;
+    handler_type handler;
+
+    //Fixed capacity FIFO, slots are reused in place so a completion never allocates
+    std::vector<item_type> pending;
+    size_t pending_head;
+    size_t pending_count;
+    std::coroutine_handle<> waiter;
+    bool armed;
+
+    static void complete(operation *op, const ::io_uring_cqe& cqe) noexcept;
+    void push_pending(item_type&& item) noexcept;
+    [[nodiscard]] item_type pop_pending() noexcept;
+
+public:
+    //Both throw std::bad_alloc if the queue for next() can't be allocated
+    multishot_recv(Executor& executor, const Handle sock, buffer_ring& ring);
+    multishot_recv(Executor& executor, const Handle sock, buffer_ring& ring, handler_type&& func);
+    ~multishot_recv();
+
+    multishot_recv(const multishot_recv&) = delete;
+    multishot_recv& operator=(const multishot_recv&) = delete;
+
+    /*
+     * Queues the multishot SQE, returns EBUSY if there's no SQE free, or if results from the
+     * previous arming are still waiting to be taken with next()
+     */
+    [[nodiscard]] std::expected<void, error::ErrorCode> start() noexcept;
+    void cancel() noexcept;
+
+    [[nodiscard]] bool is_armed() const noexcept {
+        return this->armed;
+    }
+
+    struct next_awaitable {
+        multishot_recv& self;
+
+        [[nodiscard]] bool await_ready() const noexcept {
+            return this->self.pending_count > 0 || !this->self.armed;
+        }
+        void await_suspend(std::coroutine_handle<> h) noexcept {
+            this->self.waiter = h;
+        }
+        [[nodiscard]] item_type await_resume() noexcept {
+            if (this->self.pending_count == 0) {
+                return std::unexpected(error::get_error_code_from_errno(ECANCELED));
+            }
+            return this->self.pop_pending();
+        }
+    };
+
+    //Only meaningful without a handler, resumes with the next completion in order
+    [[nodiscard]] next_awaitable next() noexcept {
+        return {*this};
+    }
+};
+
+/*
+ * Multishot accept on a listening socket
+ *
+ * One SQE keeps producing new connections until it's cancelled or errors out, so a connection
+ * storm doesn't pay for an SQE and a re-arm round trip per accepted socket
+ * The accepted handle is owned by whoever receives it, flags are applied like accept4 flags
+ *
+ * Same lifetime rules as multishot_recv: cancel() and run the executor until is_armed() is false
+ * before destroying it
+ */
+class multishot_accept : public operation {
+public:
+    using item_type = std::expected<accepted_socket, error::ErrorCode>;
+    using handler_type = std::move_only_function<void(item_type)>;
+
+private:
+    Executor& exec;
+    const Handle listener;
+    const int accept_flags;
+    handler_type handler;
+
+    std::deque<item_type> pending;
+    std::coroutine_handle<> waiter;
+    bool armed;
+
+    static void complete(operation *op, const ::io_uring_cqe& cqe) noexcept;
+
+public:
+    multishot_accept(Executor& executor,
+            const Handle sock,
+            const int flags = SOCK_NONBLOCK | SOCK_CLOEXEC) noexcept;
+    multishot_accept(Executor& executor,
+            const Handle sock,
+            handler_type&& func,
+            const int flags = SOCK_NONBLOCK | SOCK_CLOEXEC) noexcept;
+    ~multishot_accept();
+
+    multishot_accept(const multishot_accept&) = delete;
+    multishot_accept& operator=(const multishot_accept&) = delete;
+
+    //Queues the multishot SQE, returns EBUSY if there's no SQE free
+    [[nodiscard]] std::expected<void, error::ErrorCode> start() noexcept;
+    void cancel() noexcept;
+
+    [[nodiscard]] bool is_armed() const noexcept {
+        return this->armed;
+    }
+
+    struct next_awaitable {
+        multishot_accept& self;
+
+        [[nodiscard]] bool await_ready() const noexcept {
+            return !this->self.pending.empty() || !this->self.armed;
+        }
+        void await_suspend(std::coroutine_handle<> h) noexcept {
+            this->self.waiter = h;
+        }
+        [[nodiscard]] item_type await_resume() {
+            if (this->self.pending.empty()) {
+                return std::unexpected(error::get_error_code_from_errno(ECANCELED));
+            }
+            auto item = std::move(this->self.pending.front());
+            this->self.pending.pop_front();
+            return item;
+        }
+    };
+
+    //Only meaningful without a handler, resumes with the next accepted connection
+    [[nodiscard]] next_awaitable next() noexcept {
+        return {*this};
+    }
 };
 
+template<typename Prep>
+bool UringAwaitable<Prep>::await_suspend(std::coroutine_handle<> h) noexcept {
+    auto *const sqe = this->exec.get_sqe();
+    if (!sqe) {
+        this->res = -EBUSY;
+        return false;
+    }
+    std::invoke(this->prep, *sqe);
+    ::io_uring_sqe_set_data(sqe, static_cast<operation *>(this));
+    this->waiter = h;
+    return true;
+}
+
 //TODO: Naming?
 //TODO: Enforce memory lifetimes with refcounting instead of implicitly?
 class ExecutorOwnedHandle {
@@ -85,12 +1028,16 @@ public:
 };
 
 class Task {
+public:
     struct promise_type;
+
+private:
     using handle_type = std::coroutine_handle<promise_type>;
 
     OwnedCoroutine<promise_type> coro_handle;
 
-    struct promise_type {
+public:
+    struct promise_type : n3::pooled_frame {
         std::exception_ptr eptr;
 
         Task get_return_object() {
@@ -109,11 +1056,22 @@ class Task {
         }
     };
 
-public:
     Task() noexcept = default;
     Task(handle_type handle) noexcept : coro_handle{handle} {
     }
 
+    /*
+     * Run the task until its first suspension point
+     * Afterwards the executor resumes it, so the task object must outlive any in-flight operations
+     */
+    void start() const {
+        this->coro_handle.resume();
+    }
+
+    [[nodiscard]] bool done() const {
+        return this->coro_handle.done();
+    }
+
     void execute() {
         while (!coro_handle.done()) {
             coro_handle.resume();
@@ -124,15 +1082,4 @@ public:
     }
 };
 
-struct UringAwaitable {
-    bool await_ready() {
-        return false;
-    }
-    void await_suspend(std::coroutine_handle<> h) {
-        h.resume();
-    }
-    void await_resume() {
-    }
-};
-
 }; // namespace n3::linux::io_uring
@@ -86,14 +86,35 @@ public:
     }
 
     OwnedCoroutine(auto&&...args) noexcept(
-            std::is_nothrow_constructible_v<decltype(this->coro), decltype(args)...>) :
-            coro{std::forward<decltype(args)>(args)...} {
+            std::is_nothrow_constructible_v<decltype(this->coro), decltype(args)...>)
+        requires std::constructible_from<decltype(this->coro), decltype(args)...>
+            : coro{std::forward<decltype(args)>(args)...} {
+    }
+
+    //Move constructible only, the moved-from object no longer owns the frame
+    OwnedCoroutine(const OwnedCoroutine&) = delete;
+    OwnedCoroutine(OwnedCoroutine&&) noexcept = default;
+
+    //Move assignable only, destroys the currently owned frame first
+    OwnedCoroutine& operator=(const OwnedCoroutine&) = delete;
+    OwnedCoroutine& operator=(OwnedCoroutine&& other) noexcept {
+        if (this != &other) {
+            this->reset();
+            this->coro = std::move(other.coro);
+        }
+        return *this;
     }
 
     ~OwnedCoroutine() {
-        if (this->coro.has_value()) {
+        this->reset();
+    }
+
+    void reset() noexcept {
+        //Default constructed objects hold a null handle, which can't be destroyed
+        if (this->coro.has_value() && *this->coro) {
             this->coro->destroy();
         }
+        this->coro = MoveOnly<HandleType>{};
     }
 
     constexpr operator OwnedCoroutine<>() const noexcept {
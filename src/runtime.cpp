@@ -1,11 +1,16 @@
 #include <cassert>
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <expected>
 #include <memory>
 #include <optional>
+#include <pthread.h>
+#include <sched.h>
 #include <span>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include <system_error>
 #include <unistd.h>
 #include <utility>
@@ -13,8 +18,13 @@
 
 #include "runtime.h"
 
+#include "address.h"
 #include "epoll.h"
+#include "epoll_executor.h"
 #include "error.h"
+#include "handle.h"
+#include "scheduler.h"
+#include "syscalls.h"
 
 namespace n3::runtime {
 
@@ -38,4 +48,230 @@ void runtime_st::run() {
     return;
 }
 
+namespace {
+
+    using n3::linux::epoll::epoll_executor;
+    using n3::linux::epoll::EpollTask;
+
+    [[nodiscard]] std::expected<OwnedHandle, error::ErrorCode> make_reuseport_listener(
+            const ::sockaddr_storage& addr, const socklen_t addr_len) noexcept {
+        OwnedHandle sock{
+                ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)};
+        if (sock < 0) {
+            return std::unexpected(error::get_error_code_from_errno(errno));
+        }
+
+        int enable = 1;
+        if (const auto ret = n3::linux::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable); !ret) {
+            return std::unexpected(ret.error());
+        }
+        if (const auto ret = n3::linux::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable); !ret) {
+            return std::unexpected(ret.error());
+        }
+
+        if (::bind(sock, reinterpret_cast<const ::sockaddr *>(&addr), addr_len) == -1) {
+            return std::unexpected(error::get_error_code_from_errno(errno));
+        }
+        if (const auto ret = n3::linux::listen(sock, SOMAXCONN); !ret) {
+            return std::unexpected(ret.error());
+        }
+        return sock;
+    }
+
+    EpollTask accept_loop(epoll_executor& exec,
+            const Handle listener,
+            const runtime_mt::accept_handler handler) {
+        while (true) {
+            const auto ret = n3::linux::accept(listener, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (ret.has_value()) {
+                handler(exec, ret->first, ret->second);
+                continue;
+            }
+            //Connections that died in the backlog don't affect the listener
+            if (ret.error() == error::posix_error{ECONNABORTED}
+                    || ret.error() == error::posix_error{EINTR}) {
+                continue;
+            }
+            /*
+             * EAGAIN is the normal case, but anything else (such as EMFILE) also waits for the
+             * next edge instead of spinning on a listener that can't make progress right now
+             */
+            const auto ready = co_await exec.readable(listener);
+            if (!ready.has_value() && ready.error() == error::posix_error{ECANCELED}) {
+                co_return;
+            }
+        }
+    }
+
+    //Pins the calling thread to the nth CPU the process is allowed to run on
+    void pin_to_cpu(const size_t n) noexcept {
+        ::cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (::sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+            return;
+        }
+        const auto cpu_count = static_cast<size_t>(CPU_COUNT(&allowed));
+        if (cpu_count == 0) {
+            return;
+        }
+
+        size_t remaining = n % cpu_count;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            if (remaining-- == 0) {
+                ::cpu_set_t target;
+                CPU_ZERO(&target);
+                CPU_SET(cpu, &target);
+                //Pinning is best effort, an unpinned worker still works correctly
+                ::pthread_setaffinity_np(::pthread_self(), sizeof(target), &target);
+                return;
+            }
+        }
+    }
+
+    //Continuations run per loop iteration before polling for I/O again, keeps I/O latency bounded
+    constexpr size_t SCHEDULER_BUDGET = 64;
+
+} // namespace
+
+runtime_mt::runtime_mt(const size_t thread_count, const bool work_stealing) :
+        workers{},
+        sched{} {
+    //hardware_concurrency() is allowed to return 0 when it can't tell
+    const auto count = std::max<size_t>(thread_count, 1);
+    this->workers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        this->workers.emplace_back(std::make_unique<worker>());
+    }
+    if (work_stealing) {
+        this->sched = std::make_unique<n3::scheduler::work_stealing_scheduler>(
+                count, [this](const size_t idx) { this->workers[idx]->exec.wake(); });
+    }
+}
+
+runtime_mt::~runtime_mt() {
+    this->stop();
+    //jthread joins on destruction, which happens before the executors are torn down
+}
+
+[[nodiscard]] auto runtime_mt::listen(const peer_address& addr, const accept_handler& handler)
+        -> std::expected<peer_address, error::ErrorCode> {
+    ::sockaddr_storage bound{};
+    socklen_t bound_len = 0;
+    std::visit(
+            [&](const auto& address) {
+                const auto raw = address.to_sockaddr();
+                std::memcpy(&bound, &raw, sizeof(raw));
+                bound_len = sizeof(raw);
+            },
+            addr);
+
+    //A later shard failing tears down the ones already registered, listen() is all or nothing
+    const auto rollback = [this](const size_t registered) noexcept {
+        for (size_t i = 0; i < registered; ++i) {
+            auto& w = *this->workers[i];
+            //Removal cancels the parked accept loop, which runs to completion before it's dropped
+            [[maybe_unused]] const auto _ = w.exec.remove(w.listeners.back());
+            w.accept_loops.pop_back();
+            w.listeners.pop_back();
+        }
+    };
+
+    for (size_t i = 0; i < this->workers.size(); ++i) {
+        auto& w = *this->workers[i];
+
+        auto sock = make_reuseport_listener(bound, bound_len);
+        if (!sock.has_value()) {
+            rollback(i);
+            return std::unexpected(sock.error());
+        }
+        //Port 0 picks an ephemeral port, every other shard has to bind to that same port
+        if (i == 0) {
+            bound_len = sizeof(bound);
+            if (::getsockname(*sock, reinterpret_cast<::sockaddr *>(&bound), &bound_len) == -1) {
+                return std::unexpected(error::get_error_code_from_errno(errno));
+            }
+        }
+
+        //Everything that can throw happens before the listener is registered with the executor
+        const Handle listener = *sock;
+        std::optional<EpollTask> loop;
+        try {
+            w.listeners.reserve(w.listeners.size() + 1);
+            w.accept_loops.reserve(w.accept_loops.size() + 1);
+            //Lazily started, the frame exists but nothing runs until start()
+            loop.emplace(accept_loop(w.exec, listener, handler));
+        } catch (...) {
+            rollback(i);
+            throw;
+        }
+        if (const auto ret = w.exec.add(listener); !ret) {
+            rollback(i);
+            return std::unexpected(ret.error());
+        }
+
+        w.listeners.emplace_back(std::move(*sock));
+        w.accept_loops.emplace_back(std::move(*loop));
+        //Runs until the first EAGAIN, then parks on the listener until a worker starts
+        w.accept_loops.back().start();
+    }
+    return n3::net::sockaddr_to_address(bound);
+}
+
+void runtime_mt::run() {
+    for (size_t i = 0; i < this->workers.size(); ++i) {
+        auto& w = *this->workers[i];
+        w.thread = std::jthread([this, &w, i] {
+            pin_to_cpu(i);
+            if (this->sched) {
+                this->worker_loop(i);
+            } else {
+                w.exec.run();
+            }
+        });
+    }
+    for (auto& w : this->workers) {
+        w->thread.join();
+    }
+}
+
+void runtime_mt::worker_loop(const size_t idx) {
+    auto& exec = this->workers[idx]->exec;
+    auto& scheduler = *this->sched;
+    scheduler.bind(idx);
+
+    using namespace std::chrono_literals;
+    while (exec.is_active()) {
+        if (scheduler.has_local_work()) {
+            //Queued work is waiting, only poll for I/O without blocking
+            exec.run_once(0ms);
+        } else {
+            /*
+             * Flag ourselves idle before the last steal attempt, a peer pushing stealable work
+             * after that point sees the flag and wakes us out of epoll_wait
+             */
+            scheduler.set_idle(true);
+            if (scheduler.run_one()) {
+                scheduler.set_idle(false);
+                continue;
+            }
+            exec.run_once();
+            scheduler.set_idle(false);
+        }
+
+        size_t budget = SCHEDULER_BUDGET;
+        while (budget > 0 && scheduler.run_one()) {
+            --budget;
+        }
+    }
+}
+
+void runtime_mt::stop() noexcept {
+    for (auto& w : this->workers) {
+        w->exec.stop();
+    }
+}
+
 } // namespace n3::runtime
@@ -1,12 +1,22 @@
 #pragma once
 
+#include <cstddef>
+#include <expected>
 #include <functional>
+#include <memory>
+#include <thread>
 #include <tuple>
+#include <variant>
+#include <vector>
 
+#include "address.h"
 #include "buffer.h"
 #include "callbacks.h"
 #include "epoll.h"
+#include "epoll_executor.h"
 #include "error.h"
+#include "handle.h"
+#include "scheduler.h"
 
 /**
  * Runtime is the meta glue layer between top level application usage and internals such as
@@ -45,7 +55,6 @@ namespace n3::runtime {
 //};
 
 //TODO: Add configuration options through some init/builder/option struct pattern
-//TODO: Add multithreaded runtime
 //TODO: Naming?
 
 class runtime_st {
@@ -60,4 +69,76 @@ public:
     void run();
 };
 
+/*
+ * Multithreaded runtime, one epoll executor per worker thread with each worker pinned to a core
+ *
+ * Nothing is shared between workers, each one has its own epoll_ctx and handle table
+ * Listeners are sharded with SO_REUSEPORT, every worker owns its own listening socket on the same
+ * address, so the kernel spreads new connections across workers and an accepted connection stays
+ * on the worker (and core) that accepted it for its whole life
+ *
+ * Optionally runs a work stealing scheduler between the executors
+ * I/O resumptions still run on the worker that owns the handle, but coroutines can
+ * co_await scheduler()->offload() for CPU heavy sections that idle workers are allowed to steal
+ */
+class runtime_mt {
+public:
+    using peer_address = std::variant<n3::net::v4::address, n3::net::v6::address>;
+    /*
+     * Invoked on the accepting worker's thread with that worker's executor
+     * The accepted handle is nonblocking and owned by the handler from then on
+     */
+    using accept_handler = std::function<void(
+            n3::linux::epoll::epoll_executor&, const Handle, const peer_address&)>;
+
+private:
+    //Member order matters, the thread must be joined before the rest is torn down
+    struct worker {
+        n3::linux::epoll::epoll_executor exec;
+        std::vector<OwnedHandle> listeners;
+        std::vector<n3::linux::epoll::EpollTask> accept_loops;
+        std::jthread thread;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+    //Null unless work stealing was requested
+    std::unique_ptr<n3::scheduler::work_stealing_scheduler> sched;
+
+    void worker_loop(const size_t idx);
+
+public:
+    //Defaults to one worker per core available to the process
+    explicit runtime_mt(const size_t thread_count = std::thread::hardware_concurrency(),
+            const bool work_stealing = false);
+    ~runtime_mt();
+
+    runtime_mt(const runtime_mt&) = delete;
+    runtime_mt& operator=(const runtime_mt&) = delete;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return this->workers.size();
+    }
+
+    [[nodiscard]] n3::scheduler::work_stealing_scheduler *scheduler() const noexcept {
+        return this->sched.get();
+    }
+
+    /*
+     * Opens one SO_REUSEPORT listener per worker on the given address
+     * Must be called before run(), on failure no worker is left with a listener from this call
+     * Returns the bound address, which has the real port when binding to port 0
+     */
+    [[nodiscard]] auto listen(const peer_address& addr, const accept_handler& handler)
+            -> std::expected<peer_address, error::ErrorCode>;
+
+    /*
+     * Starts every worker and blocks until all of them have been stopped
+     * Stopping is final, the executors stay stopped so a stop() that races ahead of run() still
+     * counts, and a second run() returns immediately
+     */
+    void run();
+    //Thread safe
+    void stop() noexcept;
+};
+
 } // namespace n3::runtime
@@ -0,0 +1,198 @@
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace n3::scheduler {
+
+namespace {
+
+    //Which scheduler/worker the calling thread belongs to, set by work_stealing_scheduler::bind()
+    thread_local const work_stealing_scheduler *bound_scheduler = nullptr;
+    thread_local size_t bound_worker = 0;
+
+} // namespace
+
+work_deque::work_deque() noexcept : top{0}, bottom{0}, buffer{} {
+}
+
+[[nodiscard]] bool work_deque::push(std::coroutine_handle<> h) noexcept {
+    const auto b = this->bottom.load(std::memory_order_relaxed);
+    const auto t = this->top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(CAPACITY)) {
+        return false;
+    }
+    this->buffer[static_cast<size_t>(b) & MASK].store(h.address(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    this->bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+[[nodiscard]] std::coroutine_handle<> work_deque::pop() noexcept {
+    const auto b = this->bottom.load(std::memory_order_relaxed) - 1;
+    this->bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = this->top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        //Already empty, restore bottom
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+        return {};
+    }
+
+    void *item = this->buffer[static_cast<size_t>(b) & MASK].load(std::memory_order_relaxed);
+    if (t == b) {
+        //Last item, race any thieves for it
+        if (!this->top.compare_exchange_strong(
+                    t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            item = nullptr;
+        }
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return std::coroutine_handle<>::from_address(item);
+}
+
+[[nodiscard]] std::coroutine_handle<> work_deque::steal() noexcept {
+    auto t = this->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto b = this->bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return {};
+    }
+    void *item = this->buffer[static_cast<size_t>(t) & MASK].load(std::memory_order_relaxed);
+    if (!this->top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        //Lost the race against the owner or another thief
+        return {};
+    }
+    return std::coroutine_handle<>::from_address(item);
+}
+
+work_stealing_scheduler::work_stealing_scheduler(
+        const size_t worker_count, std::function<void(size_t)> wake) :
+        queues{},
+        wake_worker{std::move(wake)} {
+    this->queues.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        this->queues.emplace_back(std::make_unique<worker_queues>());
+    }
+}
+
+void work_stealing_scheduler::bind(const size_t worker) noexcept {
+    assert(worker < this->queues.size());
+    bound_scheduler = this;
+    bound_worker = worker;
+}
+
+[[nodiscard]] std::optional<size_t> work_stealing_scheduler::current() const noexcept {
+    if (bound_scheduler != this) {
+        return std::nullopt;
+    }
+    return bound_worker;
+}
+
+[[nodiscard]] work_stealing_scheduler::worker_queues& work_stealing_scheduler::local()
+        const noexcept {
+    assert(bound_scheduler == this);
+    return *this->queues[bound_worker];
+}
+
+void work_stealing_scheduler::schedule(std::coroutine_handle<> h, const affinity a) {
+    auto& q = this->local();
+    if (a == affinity::stealable && q.stealable.push(h)) {
+        this->wake_idle_peer();
+        return;
+    }
+    q.pinned.push_back(h);
+}
+
+void work_stealing_scheduler::schedule_on(const size_t worker, std::coroutine_handle<> h) {
+    assert(worker < this->queues.size());
+    auto& q = *this->queues[worker];
+    {
+        std::scoped_lock lock{q.inbox_lock};
+        q.inbox.push_back(h);
+    }
+    q.has_inbox.store(true, std::memory_order_release);
+    if (this->wake_worker) {
+        this->wake_worker(worker);
+    }
+}
+
+void work_stealing_scheduler::drain_inbox(worker_queues& q) {
+    if (!q.has_inbox.load(std::memory_order_acquire)) {
+        return;
+    }
+    //Move everything over to the pinned queue in one go, keeps the lock hold time tiny
+    std::scoped_lock lock{q.inbox_lock};
+    q.pinned.insert(q.pinned.end(), q.inbox.begin(), q.inbox.end());
+    q.inbox.clear();
+    q.has_inbox.store(false, std::memory_order_relaxed);
+}
+
+[[nodiscard]] std::coroutine_handle<> work_stealing_scheduler::steal_any() noexcept {
+    const auto count = this->queues.size();
+    //Start after ourselves so every worker doesn't gang up on worker 0
+    for (size_t i = 1; i < count; ++i) {
+        auto& victim = *this->queues[(bound_worker + i) % count];
+        if (auto h = victim.stealable.steal()) {
+            return h;
+        }
+    }
+    return {};
+}
+
+void work_stealing_scheduler::wake_idle_peer() noexcept {
+    if (!this->wake_worker) {
+        return;
+    }
+    const auto count = this->queues.size();
+    for (size_t i = 1; i < count; ++i) {
+        const auto peer = (bound_worker + i) % count;
+        //Only one peer gets the wakeup, it clears the flag so the next push picks someone else
+        if (this->queues[peer]->idle.exchange(false, std::memory_order_acq_rel)) {
+            this->wake_worker(peer);
+            return;
+        }
+    }
+}
+
+bool work_stealing_scheduler::run_one() {
+    auto& q = this->local();
+
+    this->drain_inbox(q);
+    if (!q.pinned.empty()) {
+        const auto h = q.pinned.front();
+        q.pinned.pop_front();
+        h.resume();
+        return true;
+    }
+    if (const auto h = q.stealable.pop()) {
+        h.resume();
+        return true;
+    }
+    if (const auto h = this->steal_any()) {
+        h.resume();
+        return true;
+    }
+    return false;
+}
+
+[[nodiscard]] bool work_stealing_scheduler::has_local_work() const noexcept {
+    const auto& q = this->local();
+    return !q.pinned.empty() || !q.stealable.empty()
+            || q.has_inbox.load(std::memory_order_acquire);
+}
+
+void work_stealing_scheduler::set_idle(const bool is_idle) noexcept {
+    this->local().idle.store(is_idle, std::memory_order_seq_cst);
+}
+
+} // namespace n3::scheduler
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace n3::scheduler {
+
+/*
+ * Whether a ready continuation may be moved to another worker
+ *
+ * Anything resumed by an I/O executor is pinned, executors are single threaded and a coroutine
+ * that goes on to wait on its handle again has to do so from the executor's own thread
+ * Only work that explicitly offloads itself (CPU bound parsing, compression, etc) is stealable
+ */
+enum class affinity : uint8_t {
+    pinned,
+    stealable,
+};
+
+/*
+ * Chase-Lev work stealing deque of ready coroutines
+ * "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013)
+ *
+ * The owning worker pushes and pops at the bottom (LIFO, cache warm), any other thread steals
+ * from the top (FIFO, oldest work first)
+ * Fixed power of two capacity instead of the growable array from the paper, push reports
+ * failure when full and the caller runs the work locally instead
+ */
+class work_deque {
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr size_t MASK = CAPACITY - 1;
+    static_assert((CAPACITY & MASK) == 0, "Capacity must be a power of two");
+
+    //Separate cache lines, the owner hammers bottom while thieves hammer top
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    alignas(64) std::array<std::atomic<void *>, CAPACITY> buffer;
+
+public:
+    work_deque() noexcept;
+
+    work_deque(const work_deque&) = delete;
+    work_deque& operator=(const work_deque&) = delete;
+
+    //Owner thread only, returns false if the deque is full
+    [[nodiscard]] bool push(std::coroutine_handle<> h) noexcept;
+    //Owner thread only, returns a null handle if empty
+    [[nodiscard]] std::coroutine_handle<> pop() noexcept;
+    //Any thread, returns a null handle if empty or if another thief won the race
+    [[nodiscard]] std::coroutine_handle<> steal() noexcept;
+
+    [[nodiscard]] static constexpr size_t capacity() noexcept {
+        return CAPACITY;
+    }
+
+    //Racy snapshot, only useful as a hint
+    [[nodiscard]] bool empty() const noexcept {
+        return this->bottom.load(std::memory_order_relaxed)
+                <= this->top.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+ * Work stealing scheduler for ready continuations, one set of queues per worker thread
+ *
+ * Each worker has:
+ *  - A stealable Chase-Lev deque that idle workers take from
+ *  - An owner-only FIFO for pinned continuations, never visible to other workers
+ *  - A locked inbox for continuations other threads hand back to this worker, which is the
+ *    only cross-thread path that isn't lock free and is only used when returning from offloads
+ *
+ * Worker threads must call bind() before touching the scheduler
+ */
+class work_stealing_scheduler {
+    struct alignas(64) worker_queues {
+        work_deque stealable;
+        std::deque<std::coroutine_handle<>> pinned;
+
+        std::mutex inbox_lock;
+        std::vector<std::coroutine_handle<>> inbox;
+        std::atomic<bool> has_inbox{false};
+
+        //Set while the worker is about to block waiting for I/O
+        std::atomic<bool> idle{false};
+    };
+
+    std::vector<std::unique_ptr<worker_queues>> queues;
+    //Interrupts a worker blocked in its executor, so it can come back and steal
+    std::function<void(size_t)> wake_worker;
+
+    [[nodiscard]] worker_queues& local() const noexcept;
+    void drain_inbox(worker_queues& q);
+    [[nodiscard]] std::coroutine_handle<> steal_any() noexcept;
+    void wake_idle_peer() noexcept;
+
+public:
+    work_stealing_scheduler(const size_t worker_count, std::function<void(size_t)> wake);
+
+    work_stealing_scheduler(const work_stealing_scheduler&) = delete;
+    work_stealing_scheduler& operator=(const work_stealing_scheduler&) = delete;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return this->queues.size();
+    }
+
+    //Associates the calling thread with a worker index
+    void bind(const size_t worker) noexcept;
+    //Worker index of the calling thread, empty for threads that aren't bound to this scheduler
+    [[nodiscard]] std::optional<size_t> current() const noexcept;
+
+    /*
+     * Queue on the calling worker, falls back to pinned if the stealable deque is full
+     * Throws std::bad_alloc if the pinned FIFO can't grow, the handle is left unscheduled
+     */
+    void schedule(std::coroutine_handle<> h, const affinity a = affinity::pinned);
+    //Queue on a specific worker from any thread, always pinned
+    void schedule_on(const size_t worker, std::coroutine_handle<> h);
+
+    /*
+     * Runs a single ready continuation for the calling worker
+     * Order is inbox, pinned, own stealable deque, then stealing from peers
+     * Returns false if there was nothing to run anywhere
+     */
+    bool run_one();
+    [[nodiscard]] bool has_local_work() const noexcept;
+
+    //Marks the calling worker as about to block, so new stealable work wakes it up
+    void set_idle(const bool is_idle) noexcept;
+
+    /*
+     * Awaitable that moves the rest of the coroutine onto the stealable deque
+     * Resumes with the worker it was offloaded from, so the coroutine can come back with
+     * co_await resume_on(home) before touching any handles owned by that worker's executor
+     */
+    struct offload_awaitable {
+        work_stealing_scheduler& sched;
+        std::optional<size_t> home;
+
+        [[nodiscard]] bool await_ready() noexcept {
+            this->home = this->sched.current();
+            //Not on a worker thread, nowhere to offload to so just keep going inline
+            return !this->home.has_value();
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            this->sched.schedule(h, affinity::stealable);
+        }
+        [[nodiscard]] std::optional<size_t> await_resume() const noexcept {
+            return this->home;
+        }
+    };
+
+    //Awaitable that resumes the coroutine on the given worker, pinned there
+    struct resume_on_awaitable {
+        work_stealing_scheduler& sched;
+        size_t worker;
+
+        [[nodiscard]] bool await_ready() const noexcept {
+            return this->sched.current() == this->worker;
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            this->sched.schedule_on(this->worker, h);
+        }
+        void await_resume() const noexcept {
+        }
+    };
+
+    [[nodiscard]] offload_awaitable offload() noexcept {
+        return {*this, std::nullopt};
+    }
+    [[nodiscard]] resume_on_awaitable resume_on(const size_t worker) noexcept {
+        return {*this, worker};
+    }
+};
+
+} // namespace n3::scheduler
@@ -114,63 +114,55 @@ public:
 
     //TODO: Probably needs a callback invocable concept that replicates the bind_front arg stacking
     //TODO: Verify that you can construct a callback object with the template types/args
-    //TODO: Do I need to make the noexcept qualifier here conditional on something?
+    /*
+     * Sends only queue the buffer on the handle's write queue, the executor flushes every dirty
+     * handle once per loop iteration with a single sendmsg, so back to back sends (header, body,
+     * trailer) coalesce into one syscall and can never reorder against data already queued
+     * The callback runs from the executor once the whole buffer has been sent, or with the error
+     */
     template<typename F, typename... Args>
         requires std::invocable<F, std::expected<size_t, error::ErrorCode>, Args...>
-    void send(const int sock, const RefBuffer buf, const int flags, F&& cb_func, Args&&...cb_args)
-            const noexcept {
+    void send(n3::linux::epoll::epoll_executor& exec,
+            const int sock,
+            const RefBuffer buf,
+            F&& cb_func,
+            Args&&...cb_args) const {
         //TODO: Verify that any child types that override match the same signature
         //TODO: Probably going to remove this in favour of partial specialization for socket types
         if constexpr (std::is_member_function_pointer_v<decltype(&T::send)>) {
-            return static_cast<T const *>(this)->send(sock, buf, flags);
-        }
-        /*
-         * TODO: This is actually wrong given the current "read/write event queue per socket" design
-         * Attempting an immediate send would reorder data since there may be pending writes already
-         * queued up that need to be sent first
-         * So instead of calling the syscall here directly, this should probably call some higher
-         * level wrapper that flushes the pending write queue
-         */
-        auto&& ret = n3::linux::send(sock, buf, flags);
-
-        //Call the callback straight away if things immediately succeed
-        if (ret.has_value()) {
-            std::invoke(cb_func, ret, cb_args...);
-            return;
+            return static_cast<T const *>(this)->send(exec, sock, buf);
         }
+        exec.send(sock,
+                buf,
+                n3::callback<std::expected<size_t, error::ErrorCode>>{
+                        std::forward<F>(cb_func), std::forward<Args>(cb_args)...});
+    }
 
-        assert(!ret.has_value());
-
-        if (ret.error() == error::posix_error{EAGAIN}) {
-            //TODO: Save the callback in the event loop somehow for future use when complete
-            /*
-             * TODO: Before I can figure out how to store async context data,
-             * I need to figure out how to handle multi-read/write calls
-             * What happens if someone calls TcpSocket::read 3 times in a row?
-             * As well as how that differs between single syscall wrapper functions, and composed
-             * multi-syscall functions (read_once() vs read() vs read_exact())
-             *
-             * Also needs to generalize to stuff like bind(), connect(), and accept(), not just
-             * read and write
-             *
-             * Do we:
-             *  - Forbid it entirely (UB)
-             *  - Check for it (return an error)
-             *  - Replace previous slot (dedicated read/write handler is registered with IO loop)
-             *  - Queue them up back-to-back
-             *       - on a smart read() wrapper, does that mean a full EAGAIN exhaustion per call?
-             *  - Try and cleverly merge them under the hood
-             *       - growing buffer,
-             *       - span merging
-             *       - transparently switch to vectored read/write syscalls (multiple refbuffers queued up)
-             * I WANT TO BE CLEVER ABOUT IT!!!
-             */
-            [[maybe_unused]] n3::callback<std::expected<size_t, error::ErrorCode>> cb{
-                    std::forward<F>(cb_func), std::forward<Args...>(cb_args...)};
-            return;
+    /*
+     * Scatter-gather send of a fixed argument list, e.g. send(exec, sock, type, length, body)
+     * Each argument gets one iovec in a stack array sized from the pack, see n3::gather, so a
+     * binary header followed by a payload is a single sendmsg with no copies and no allocation
+     * Returns the bytes sent, which can be short on a non-blocking socket like any other send
+     *
+     * The parts go straight to sendmsg instead of onto the executor's queue, since queueing would
+     * need them to outlive the call, but the queue is flushed first so nothing sent through
+     * the executor earlier gets overtaken, EAGAIN if it couldn't be flushed completely
+     * Not dispatched to T::send, an override there sends one buffer and would split the parts
+     * over several syscalls
+     */
+    template<GatherPart... Parts>
+        requires(sizeof...(Parts) > 0 && sizeof...(Parts) <= IOV_MAX)
+    std::expected<size_t, error::ErrorCode> send(n3::linux::epoll::epoll_executor& exec,
+            const int sock,
+            const Parts&...parts) const noexcept {
+        if (const auto flushed = exec.flush(sock); !flushed.has_value()) {
+            return std::unexpected(flushed.error());
         }
-        //Error value with no special meaning, call the callback immediately
-        std::invoke(cb_func, ret, cb_args...);
+        auto iovecs = n3::gather(parts...);
+        ::msghdr msg{};
+        msg.msg_iov = iovecs.data();
+        msg.msg_iovlen = iovecs.size();
+        return n3::linux::sendmsg(sock, msg, MSG_NOSIGNAL);
     }
 
     //TODO: What is the plan with socket object syscall wrapper return types?
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <expected>
 #include <fcntl.h>
+#include <functional>
 #include <linux/filter.h>
 #include <linux/icmp.h>
 #include <linux/in.h>
@@ -16,6 +17,7 @@
 #include <linux/udp.h>
 #include <memory>
 #include <netdb.h>
+#include <ranges>
 #include <span>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -361,7 +363,8 @@ std::expected<std::span<std::byte>, error::ErrorCode> getsockopt(
         return std::unexpected(error::get_error_code_from_errno(EINVAL));
     }
 
-    socklen_t optlen = 0;
+    //Value-result argument, the kernel needs to know how much space it has to write into
+    socklen_t optlen = option_buf.as_span().size_bytes();
     const auto ret = ::getsockopt(sock, level, option, option_buf.as_span().data(), &optlen);
     if (ret == -1) {
         return std::unexpected(error::get_error_code_from_errno(errno));
@@ -412,6 +415,50 @@ std::expected<size_t, error::ErrorCode> writev(
     return ret;
 }
 
+namespace {
+template<auto Syscall>
+std::expected<size_t, error::ErrorCode> vectored_io(
+        const int fd, std::span<const RefBuffer> bufs) noexcept {
+    size_t total = 0;
+    while (true) {
+        const auto chunk = bufs.first(std::min<size_t>(bufs.size(), IOV_MAX));
+        const auto ret = Syscall(fd,
+                reinterpret_cast<const ::iovec *>(chunk.data()),
+                static_cast<int>(chunk.size()));
+        if (ret == -1) {
+            if (total > 0) {
+                return total;
+            }
+            return std::unexpected(error::get_error_code_from_errno(errno));
+        }
+        assert(ret >= 0);
+        total += static_cast<size_t>(ret);
+        bufs = bufs.subspan(chunk.size());
+        if (bufs.empty()) {
+            break;
+        }
+
+        //Short transfer, the fd is full/drained (or at EOF) so the next chunk would only fail
+        const auto chunk_bytes = std::ranges::fold_left(
+                chunk | std::views::transform(&RefBuffer::size), size_t{0}, std::plus<size_t>());
+        if (static_cast<size_t>(ret) < chunk_bytes) {
+            break;
+        }
+    }
+    return total;
+}
+} // namespace
+
+std::expected<size_t, error::ErrorCode> readv(
+        const int fd, std::span<const RefBuffer> bufs) noexcept {
+    return vectored_io<::readv>(fd, bufs);
+}
+
+std::expected<size_t, error::ErrorCode> writev(
+        const int fd, std::span<const RefBuffer> bufs) noexcept {
+    return vectored_io<::writev>(fd, bufs);
+}
+
 std::expected<size_t, error::ErrorCode> send(
         const int sock, const RefBuffer buf, const int flags) noexcept {
     const auto ret = ::send(sock, buf.as_span().data(), buf.as_span().size_bytes(), flags);
@@ -461,6 +508,26 @@ std::expected<size_t, error::ErrorCode> recv(
     return ret;
 }
 
+std::expected<size_t, error::ErrorCode> sendmmsg(
+        const int sock, std::span<::mmsghdr> msgs, const int flags) noexcept {
+    const auto ret = ::sendmmsg(sock, msgs.data(), static_cast<unsigned int>(msgs.size()), flags);
+    if (ret == -1) {
+        return std::unexpected(error::get_error_code_from_errno(errno));
+    }
+    return ret;
+}
+
+std::expected<size_t, error::ErrorCode> recvmmsg(
+        const int sock, std::span<::mmsghdr> msgs, const int flags) noexcept {
+    //No timeout, MSG_WAITFORONE or a non-blocking socket is what bounds the wait
+    const auto ret = ::recvmmsg(
+            sock, msgs.data(), static_cast<unsigned int>(msgs.size()), flags, nullptr);
+    if (ret == -1) {
+        return std::unexpected(error::get_error_code_from_errno(errno));
+    }
+    return ret;
+}
+
 std::expected<std::pair<size_t, std::variant<n3::net::v4::address, n3::net::v6::address>>,
         error::ErrorCode>
         recvfrom(const int sock, RefBuffer buf, const int flags) noexcept {
@@ -491,6 +558,15 @@ std::expected<std::pair<size_t, ::msghdr>, error::ErrorCode> recvmsg(
     return {{ret, msg}};
 }
 
+std::expected<size_t, error::ErrorCode> recvmsg(
+        const int sock, ::msghdr& msg, const int flags) noexcept {
+    const auto ret = ::recvmsg(sock, &msg, flags);
+    if (ret == -1) {
+        return std::unexpected(error::get_error_code_from_errno(errno));
+    }
+    return ret;
+}
+
 std::expected<void, error::ErrorCode> listen(const int sock, const int backlog) noexcept {
     const auto ret = ::listen(sock, backlog);
     if (ret == -1) {
@@ -501,11 +577,12 @@ std::expected<void, error::ErrorCode> listen(const int sock, const int backlog)
 
 std::expected<std::pair<int, std::variant<n3::net::v4::address, n3::net::v6::address>>,
         error::ErrorCode>
-        accept(const int sock) noexcept {
+        accept(const int sock, const int flags) noexcept {
     ::sockaddr_storage recv_addr{};
     socklen_t recv_addr_len = sizeof(recv_addr);
 
-    const auto ret = ::accept(sock, reinterpret_cast<::sockaddr *>(&recv_addr), &recv_addr_len);
+    const auto ret = ::accept4(
+            sock, reinterpret_cast<::sockaddr *>(&recv_addr), &recv_addr_len, flags);
     if (ret == -1) {
         return std::unexpected(error::get_error_code_from_errno(errno));
     }
@@ -514,4 +591,17 @@ std::expected<std::pair<int, std::variant<n3::net::v4::address, n3::net::v6::add
     return {{ret, address}};
 }
 
+std::expected<std::variant<n3::net::v4::address, n3::net::v6::address>, error::ErrorCode>
+        getpeername(const int sock) noexcept {
+    ::sockaddr_storage peer_addr{};
+    socklen_t peer_addr_len = sizeof(peer_addr);
+
+    const auto ret
+            = ::getpeername(sock, reinterpret_cast<::sockaddr *>(&peer_addr), &peer_addr_len);
+    if (ret == -1) {
+        return std::unexpected(error::get_error_code_from_errno(errno));
+    }
+    return n3::net::sockaddr_to_address(peer_addr);
+}
+
 } // namespace n3::linux
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <array>
+#include <concepts>
+#include <cstring>
 #include <expected>
+#include <optional>
 #include <span>
 #include <sys/socket.h>
+#include <type_traits>
 
 #include "address.h"
 #include "buffer.h"
@@ -19,12 +24,33 @@ std::expected<void, error::ErrorCode> setsockopt(
 std::expected<std::span<std::byte>, error::ErrorCode> getsockopt(
         const int sock, const int level, const int option, const RefBuffer option_buf) noexcept;
 
-//TODO: Convert to use RefMultiBuffer
+//Copies into an iovec array first, prefer the RefBuffer overloads below
 std::expected<size_t, error::ErrorCode> readv(
         const int fd, std::span<std::span<std::byte>> bufs) noexcept;
 std::expected<size_t, error::ErrorCode> writev(
         const int fd, std::span<std::span<std::byte>> bufs) noexcept;
 
+/*
+ * RefBuffer is layout compatible with iovec, so these hand the array to the kernel as is
+ * More than IOV_MAX buffers are issued as several calls, stopping at the first short transfer
+ * An error after some bytes already moved returns that partial count instead, the same error
+ * comes back on the next call
+ */
+std::expected<size_t, error::ErrorCode> readv(
+        const int fd, std::span<const RefBuffer> bufs) noexcept;
+std::expected<size_t, error::ErrorCode> writev(
+        const int fd, std::span<const RefBuffer> bufs) noexcept;
+
+//Templated so a std::vector<RefBuffer> argument isn't ambiguous with the span overloads
+std::expected<size_t, error::ErrorCode> readv(
+        const int fd, const std::same_as<RefMultiBuffer> auto& bufs) noexcept {
+    return readv(fd, std::span<const RefBuffer>{bufs.data(), bufs.size()});
+}
+std::expected<size_t, error::ErrorCode> writev(
+        const int fd, const std::same_as<RefMultiBuffer> auto& bufs) noexcept {
+    return writev(fd, std::span<const RefBuffer>{bufs.data(), bufs.size()});
+}
+
 std::expected<size_t, error::ErrorCode> send(
         const int sock, const RefBuffer buf, const int flags) noexcept;
 
@@ -36,7 +62,7 @@ std::expected<size_t, error::ErrorCode> sendto(
             buf.as_span().data(),
             buf.as_span().size_bytes(),
             flags,
-            dynamic_cast<::sockaddr *>(std::addressof(raw_addr)),
+            reinterpret_cast<const ::sockaddr *>(std::addressof(raw_addr)),
             sizeof(raw_addr));
     if (ret == -1) {
         return std::unexpected(error::get_error_code_from_errno(errno));
@@ -47,23 +73,76 @@ std::expected<size_t, error::ErrorCode> sendto(
 std::expected<size_t, error::ErrorCode> sendmsg(
         const int sock, const ::msghdr& msg, const int flags) noexcept;
 
+/*
+ * One control message, laid out so CMSG_FIRSTHDR finds it when attached to a msghdr
+ * Lives on the caller's stack for the duration of the sendmsg it's attached to
+ */
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class control_message {
+    alignas(::cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(T))> buf{};
+
+public:
+    control_message(const int level, const int type, const T& value) noexcept {
+        auto *const hdr = reinterpret_cast<::cmsghdr *>(this->buf.data());
+        hdr->cmsg_level = level;
+        hdr->cmsg_type = type;
+        hdr->cmsg_len = CMSG_LEN(sizeof(T));
+        std::memcpy(CMSG_DATA(hdr), &value, sizeof(T));
+    }
+
+    //Only holds a single message, replaces any control data msg already pointed at
+    void attach(::msghdr& msg) noexcept {
+        msg.msg_control = this->buf.data();
+        msg.msg_controllen = this->buf.size();
+    }
+};
+
+//Payload of the first control message in msg with the given level and type, if any
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+[[nodiscard]] std::optional<T> find_control_message(
+        const ::msghdr& msg, const int level, const int type) noexcept {
+    //CMSG_NXTHDR takes a non-const msghdr even though it never writes to it
+    auto& walk = const_cast<::msghdr&>(msg);
+    for (auto *hdr = CMSG_FIRSTHDR(&walk); hdr; hdr = CMSG_NXTHDR(&walk, hdr)) {
+        if (hdr->cmsg_level == level && hdr->cmsg_type == type
+                && hdr->cmsg_len >= CMSG_LEN(sizeof(T))) {
+            T value;
+            std::memcpy(&value, CMSG_DATA(hdr), sizeof(T));
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
 std::expected<size_t, error::ErrorCode> recv(
         const int sock, RefBuffer buf, const int flags) noexcept;
 
+//Batched datagram IO, returns how many of the headers were filled or sent
+std::expected<size_t, error::ErrorCode> sendmmsg(
+        const int sock, std::span<::mmsghdr> msgs, const int flags) noexcept;
+std::expected<size_t, error::ErrorCode> recvmmsg(
+        const int sock, std::span<::mmsghdr> msgs, const int flags) noexcept;
+
 std::expected<std::pair<size_t, std::variant<n3::net::v4::address, n3::net::v6::address>>,
         error::ErrorCode>
         recvfrom(const int sock, RefBuffer buf, const int flags) noexcept;
 
 std::expected<std::pair<size_t, ::msghdr>, error::ErrorCode> recvmsg(
         const int sock, const int flags) noexcept;
+//Caller supplied msghdr, for receives that need a source address or control messages
+std::expected<size_t, error::ErrorCode> recvmsg(
+        const int sock, ::msghdr& msg, const int flags) noexcept;
 
 std::expected<long, error::ErrorCode> sysconf(const int name) noexcept;
 
 template<n3::net::AddressType T>
 std::expected<void, error::ErrorCode> connect(const int sock, const T& addr) noexcept {
     const auto raw_addr = addr.to_sockaddr();
-    const auto ret = ::connect(
-            sock, dynamic_cast<::sockaddr *>(std::addressof(raw_addr)), sizeof(raw_addr));
+    const auto ret = ::connect(sock,
+            reinterpret_cast<const ::sockaddr *>(std::addressof(raw_addr)),
+            sizeof(raw_addr));
     if (ret == -1) {
         //TODO: Probably want to move this one level of abstraction up, and keep the syscall wrapper simple
         if (errno == EINPROGRESS) {
@@ -79,8 +158,9 @@ std::expected<void, error::ErrorCode> connect(const int sock, const T& addr) noe
 template<n3::net::AddressType T>
 std::expected<void, error::ErrorCode> bind(const int sock, const T& addr) noexcept {
     const auto raw_addr = addr.to_sockaddr();
-    const auto ret
-            = ::bind(sock, dynamic_cast<::sockaddr *>(std::addressof(raw_addr)), sizeof(raw_addr));
+    const auto ret = ::bind(sock,
+            reinterpret_cast<const ::sockaddr *>(std::addressof(raw_addr)),
+            sizeof(raw_addr));
     if (ret == -1) {
         return std::unexpected(error::get_error_code_from_errno(errno));
     }
@@ -89,8 +169,12 @@ std::expected<void, error::ErrorCode> bind(const int sock, const T& addr) noexce
 
 std::expected<void, error::ErrorCode> listen(const int sock, const int backlog) noexcept;
 
+//Flags are passed through to accept4, such as SOCK_NONBLOCK and SOCK_CLOEXEC
 std::expected<std::pair<int, std::variant<n3::net::v4::address, n3::net::v6::address>>,
         error::ErrorCode>
-        accept(const int sock) noexcept;
+        accept(const int sock, const int flags = 0) noexcept;
+
+std::expected<std::variant<n3::net::v4::address, n3::net::v6::address>, error::ErrorCode>
+        getpeername(const int sock) noexcept;
 
 } // namespace n3::linux
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <linux/udp.h>
+#include <netinet/in.h>
+#include <span>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <variant>
+#include <vector>
+
+#include "udp.h"
+
+#include "address.h"
+#include "buffer.h"
+#include "error.h"
+#include "handle.h"
+#include "syscalls.h"
+
+namespace n3::net::linux::udp {
+
+RecvBatch::RecvBatch(const size_t count, const size_t slot_size_arg) :
+        storage(count * slot_size_arg),
+        headers(count),
+        iovecs(count),
+        sources(count),
+        slot_size{slot_size_arg},
+        filled{0} {
+    assert(count > 0 && slot_size_arg > 0);
+    for (size_t i = 0; i < count; ++i) {
+        this->iovecs[i] = {this->storage.data() + (i * this->slot_size), this->slot_size};
+        auto& hdr = this->headers[i].msg_hdr;
+        hdr.msg_iov = &this->iovecs[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_name = &this->sources[i];
+    }
+}
+
+[[nodiscard]] std::span<::mmsghdr> RecvBatch::prepare() noexcept {
+    //Only the fields the kernel writes back need resetting, the rest stays wired up
+    for (auto& msg : this->headers) {
+        msg.msg_hdr.msg_namelen = sizeof(::sockaddr_storage);
+        msg.msg_hdr.msg_flags = 0;
+        msg.msg_len = 0;
+    }
+    this->filled = 0;
+    return this->headers;
+}
+
+void RecvBatch::set_filled(const size_t count) noexcept {
+    assert(count <= this->capacity());
+    this->filled = count;
+}
+
+[[nodiscard]] RefBuffer RecvBatch::payload(const size_t idx) noexcept {
+    assert(idx < this->filled);
+    //msg_len is the full datagram length when it was truncated, clamp to what was stored
+    return std::span{this->storage}.subspan(idx * this->slot_size,
+            std::min<size_t>(this->headers[idx].msg_len, this->slot_size));
+}
+
+[[nodiscard]] std::variant<v4::address, v6::address> RecvBatch::source(
+        const size_t idx) const noexcept {
+    assert(idx < this->filled);
+    return n3::net::sockaddr_to_address(this->sources[idx]);
+}
+
+[[nodiscard]] bool RecvBatch::truncated(const size_t idx) const noexcept {
+    assert(idx < this->filled);
+    return (this->headers[idx].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+}
+
+SendBatch::SendBatch(const size_t count) :
+        headers(count),
+        iovecs(count),
+        destinations(count),
+        head{0},
+        filled{0} {
+    assert(count > 0);
+    for (size_t i = 0; i < count; ++i) {
+        auto& hdr = this->headers[i].msg_hdr;
+        hdr.msg_iov = &this->iovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+}
+
+[[nodiscard]] ::mmsghdr& SendBatch::next(const RefBuffer data) noexcept {
+    assert(!this->full());
+    const auto idx = this->filled++;
+    this->iovecs[idx] = data;
+    auto& msg = this->headers[idx];
+    msg.msg_hdr.msg_name = &this->destinations[idx];
+    msg.msg_len = 0;
+    return msg;
+}
+
+[[nodiscard]] bool SendBatch::push(const RefBuffer data) noexcept {
+    if (this->full()) {
+        return false;
+    }
+    auto& msg = this->next(data);
+    msg.msg_hdr.msg_name = nullptr;
+    msg.msg_hdr.msg_namelen = 0;
+    return true;
+}
+
+void SendBatch::advance(const size_t count) noexcept {
+    assert(count <= this->size());
+    this->head += count;
+    if (this->head == this->filled) {
+        this->clear();
+    }
+}
+
+void SendBatch::clear() noexcept {
+    this->head = 0;
+    this->filled = 0;
+}
+
+SegmentedRecv::SegmentedRecv(const size_t capacity) :
+        storage(capacity),
+        control{},
+        source_addr{},
+        iov{storage.data(), storage.size()},
+        msg{},
+        length{0},
+        seg_size{0} {
+    this->msg.msg_name = &this->source_addr;
+    this->msg.msg_iov = &this->iov;
+    this->msg.msg_iovlen = 1;
+}
+
+[[nodiscard]] ::msghdr& SegmentedRecv::prepare() noexcept {
+    this->msg.msg_namelen = sizeof(this->source_addr);
+    this->msg.msg_control = this->control.data();
+    this->msg.msg_controllen = this->control.size();
+    this->msg.msg_flags = 0;
+    this->length = 0;
+    this->seg_size = 0;
+    return this->msg;
+}
+
+void SegmentedRecv::set_received(const size_t bytes) noexcept {
+    this->length = std::min(bytes, this->storage.size());
+    const auto gro_size = n3::linux::find_control_message<int>(this->msg, IPPROTO_UDP, UDP_GRO);
+    this->seg_size = gro_size ? static_cast<size_t>(*gro_size) : this->length;
+}
+
+[[nodiscard]] RefBuffer SegmentedRecv::segment(const size_t idx) noexcept {
+    assert(idx < this->segment_count());
+    const auto offset = idx * this->seg_size;
+    return std::span{this->storage}.subspan(
+            offset, std::min(this->seg_size, this->length - offset));
+}
+
+[[nodiscard]] std::variant<v4::address, v6::address> SegmentedRecv::source() const noexcept {
+    return n3::net::sockaddr_to_address(this->source_addr);
+}
+
+[[nodiscard]] Handle UdpSocket::open(const int family) {
+    const auto fd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (fd == -1) {
+        throw error::get_error_code_from_errno(errno);
+    }
+    return fd;
+}
+
+UdpSocket::UdpSocket() : sock{open(AF_INET)} {
+}
+
+UdpSocket::UdpSocket(const Handle sock_arg) : sock{sock_arg} {
+}
+
+std::expected<size_t, error::ErrorCode> UdpSocket::recv_batch(
+        RecvBatch& batch, const int flags) const noexcept {
+    const auto ret = n3::linux::recvmmsg(this->sock, batch.prepare(), flags);
+    if (ret) {
+        batch.set_filled(*ret);
+    }
+    return ret;
+}
+
+std::expected<size_t, error::ErrorCode> UdpSocket::send_batch(
+        SendBatch& batch, const int flags) const noexcept {
+    if (batch.empty()) {
+        return 0;
+    }
+    //MSG_NOSIGNAL to match the TCP send path, a connected UDP socket can also raise SIGPIPE
+    const auto ret = n3::linux::sendmmsg(this->sock, batch.pending(), flags | MSG_NOSIGNAL);
+    if (ret) {
+        batch.advance(*ret);
+    }
+    return ret;
+}
+
+std::expected<void, error::ErrorCode> UdpSocket::set_gro(const bool enabled) const noexcept {
+    int value = enabled ? 1 : 0;
+    return n3::linux::setsockopt(this->sock, IPPROTO_UDP, UDP_GRO, &value);
+}
+
+std::expected<size_t, error::ErrorCode> UdpSocket::recv_segmented(
+        SegmentedRecv& buf, const int flags) const noexcept {
+    const auto ret = n3::linux::recvmsg(this->sock, buf.prepare(), flags);
+    if (ret) {
+        buf.set_received(*ret);
+    }
+    return ret;
+}
+
+std::expected<size_t, error::ErrorCode> UdpSocket::send_segmented(::msghdr& msg,
+        RefBuffer data,
+        const uint16_t segment_size,
+        const int flags) const noexcept {
+    //RefBuffer is layout compatible with iovec, see its assert_guarantees
+    msg.msg_iov = reinterpret_cast<::iovec *>(&data);
+    msg.msg_iovlen = 1;
+    n3::linux::control_message<uint16_t> gso{IPPROTO_UDP, UDP_SEGMENT, segment_size};
+    gso.attach(msg);
+    return n3::linux::sendmsg(this->sock, msg, flags | MSG_NOSIGNAL);
+}
+
+} // namespace n3::net::linux::udp
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <linux/udp.h>
+#include <netinet/in.h>
+#include <ranges>
+#include <span>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "address.h"
+#include "buffer.h"
+#include "error.h"
+#include "handle.h"
+#include "socket.h"
+#include "syscalls.h"
+
+namespace n3::net::linux::udp {
+
+/*
+ * Preallocated recvmmsg batch, one fixed size slot per datagram
+ * Headers, iovecs, source addresses and the slot storage are all allocated once up front, a
+ * receive only resets the per-call lengths so a full batch costs one syscall and no allocation
+ */
+class RecvBatch {
+    std::vector<std::byte> storage;
+    std::vector<::mmsghdr> headers;
+    std::vector<::iovec> iovecs;
+    std::vector<::sockaddr_storage> sources;
+    size_t slot_size;
+    size_t filled;
+
+public:
+    RecvBatch(const size_t count, const size_t slot_size_arg);
+
+    //Headers point into the vectors above, moving would leave them dangling
+    RecvBatch(const RecvBatch&) = delete;
+    RecvBatch(RecvBatch&&) = delete;
+
+    RecvBatch& operator=(const RecvBatch&) = delete;
+    RecvBatch& operator=(RecvBatch&&) = delete;
+
+    //Resets the lengths the kernel overwrote last time and hands back every header
+    [[nodiscard]] std::span<::mmsghdr> prepare() noexcept;
+    void set_filled(const size_t count) noexcept;
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return this->headers.size();
+    }
+    [[nodiscard]] size_t size() const noexcept {
+        return this->filled;
+    }
+    [[nodiscard]] bool empty() const noexcept {
+        return this->filled == 0;
+    }
+
+    //Received bytes of datagram idx, valid until the next receive into this batch
+    [[nodiscard]] RefBuffer payload(const size_t idx) noexcept;
+    [[nodiscard]] std::variant<v4::address, v6::address> source(const size_t idx) const noexcept;
+    //The datagram was bigger than the slot and the rest of it was dropped
+    [[nodiscard]] bool truncated(const size_t idx) const noexcept;
+};
+
+/*
+ * Preallocated sendmmsg batch
+ * Payloads aren't copied, each entry points at the caller's buffer, which has to stay alive until
+ * the entry has been sent
+ */
+class SendBatch {
+    std::vector<::mmsghdr> headers;
+    std::vector<::iovec> iovecs;
+    std::vector<::sockaddr_storage> destinations;
+    //Entries before head were already sent by an earlier partial sendmmsg
+    size_t head;
+    size_t filled;
+
+    [[nodiscard]] ::mmsghdr& next(const RefBuffer data) noexcept;
+
+public:
+    explicit SendBatch(const size_t count);
+
+    //Headers point into the vectors above, moving would leave them dangling
+    SendBatch(const SendBatch&) = delete;
+    SendBatch(SendBatch&&) = delete;
+
+    SendBatch& operator=(const SendBatch&) = delete;
+    SendBatch& operator=(SendBatch&&) = delete;
+
+    //Queues a datagram for a connected socket, false if the batch is full
+    [[nodiscard]] bool push(const RefBuffer data) noexcept;
+
+    //Queues a datagram for dest, false if the batch is full
+    template<n3::net::AddressType U>
+    [[nodiscard]] bool push(const RefBuffer data, const U& dest) noexcept {
+        if (this->full()) {
+            return false;
+        }
+        const auto raw_addr = dest.to_sockaddr();
+        static_assert(sizeof(raw_addr) <= sizeof(::sockaddr_storage));
+        auto& hdr = this->next(data);
+        std::memcpy(hdr.msg_hdr.msg_name, &raw_addr, sizeof(raw_addr));
+        hdr.msg_hdr.msg_namelen = sizeof(raw_addr);
+        return true;
+    }
+
+    //Entries not sent yet
+    [[nodiscard]] std::span<::mmsghdr> pending() noexcept {
+        return std::span{this->headers}.subspan(this->head, this->filled - this->head);
+    }
+    //Marks the first count pending entries sent, the batch empties once all of them are
+    void advance(const size_t count) noexcept;
+    void clear() noexcept;
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return this->headers.size();
+    }
+    [[nodiscard]] size_t size() const noexcept {
+        return this->filled - this->head;
+    }
+    [[nodiscard]] bool empty() const noexcept {
+        return this->head == this->filled;
+    }
+    [[nodiscard]] bool full() const noexcept {
+        return this->filled == this->headers.size();
+    }
+};
+
+/*
+ * Receive buffer for a socket with UDP_GRO enabled
+ * The kernel coalesces a run of equal sized datagrams from the same flow into one receive, and
+ * says how big each original datagram was in a UDP_GRO control message
+ * The payload is those datagrams back to back, the last one possibly shorter than the rest
+ * A receive that wasn't coalesced has no control message and is a single segment
+ */
+class SegmentedRecv {
+    std::vector<std::byte> storage;
+    alignas(::cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(int))> control;
+    ::sockaddr_storage source_addr;
+    ::iovec iov;
+    ::msghdr msg;
+    size_t length;
+    size_t seg_size;
+
+public:
+    //64 KiB covers the largest coalesced receive the kernel will build
+    explicit SegmentedRecv(const size_t capacity = 65535);
+
+    //msg points into this object, moving would leave it dangling
+    SegmentedRecv(const SegmentedRecv&) = delete;
+    SegmentedRecv(SegmentedRecv&&) = delete;
+
+    SegmentedRecv& operator=(const SegmentedRecv&) = delete;
+    SegmentedRecv& operator=(SegmentedRecv&&) = delete;
+
+    [[nodiscard]] ::msghdr& prepare() noexcept;
+    //Records the received length and picks the segment size out of the control messages
+    void set_received(const size_t bytes) noexcept;
+
+    [[nodiscard]] RefBuffer payload() noexcept {
+        return std::span{this->storage}.first(this->length);
+    }
+    [[nodiscard]] size_t segment_size() const noexcept {
+        return this->seg_size;
+    }
+    [[nodiscard]] size_t segment_count() const noexcept {
+        return this->seg_size == 0 ? 0 : (this->length + this->seg_size - 1) / this->seg_size;
+    }
+    [[nodiscard]] RefBuffer segment(const size_t idx) noexcept;
+
+    //View over the original datagrams, each one a RefBuffer into the payload
+    [[nodiscard]] auto segments() noexcept {
+        return std::views::iota(0uz, this->segment_count())
+                | std::views::transform([this](const size_t idx) { return this->segment(idx); });
+    }
+
+    [[nodiscard]] std::variant<v4::address, v6::address> source() const noexcept;
+    [[nodiscard]] bool truncated() const noexcept {
+        return (this->msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0;
+    }
+};
+
+class UdpSocket : public n3::net::linux::socket<UdpSocket> {
+    OwnedHandle sock;
+
+    [[nodiscard]] static Handle open(const int family);
+    template<typename T>
+    [[nodiscard]] static Handle open_for(const T& raw_addr) {
+        return open(reinterpret_cast<const ::sockaddr&>(raw_addr).sa_family);
+    }
+
+public:
+    //Non-blocking, unbound IPv4 datagram socket
+    UdpSocket();
+    UdpSocket(const Handle sock_arg);
+
+    //Non-blocking datagram socket of bind_addr's family, bound to it
+    template<n3::net::AddressType U>
+    explicit UdpSocket(const U& bind_addr) : sock{open_for(bind_addr.to_sockaddr())} {
+        //Straight to the syscall, socket::bind would dispatch back to UdpSocket's inherited bind
+        if (const auto ret = n3::linux::bind(this->sock, bind_addr); !ret) {
+            throw ret.error();
+        }
+    }
+
+    UdpSocket(const UdpSocket&) noexcept = delete;
+    UdpSocket(UdpSocket&&) noexcept = default;
+
+    UdpSocket& operator=(const UdpSocket&) noexcept = delete;
+    UdpSocket& operator=(UdpSocket&&) noexcept = default;
+
+    [[nodiscard]] Handle native_handle() const noexcept {
+        return this->sock;
+    }
+
+    /*
+     * Fills as much of the batch as is waiting with one recvmmsg, returns how many arrived
+     * Both are non-blocking, so EAGAIN means there was nothing to do
+     */
+    std::expected<size_t, error::ErrorCode> recv_batch(
+            RecvBatch& batch, const int flags = 0) const noexcept;
+    //Sends the batch's pending entries with one sendmmsg and advances past whatever was sent
+    std::expected<size_t, error::ErrorCode> send_batch(
+            SendBatch& batch, const int flags = 0) const noexcept;
+
+    //Lets the kernel coalesce received datagrams, read them with recv_segmented
+    std::expected<void, error::ErrorCode> set_gro(const bool enabled) const noexcept;
+    std::expected<size_t, error::ErrorCode> recv_segmented(
+            SegmentedRecv& buf, const int flags = 0) const noexcept;
+
+    /*
+     * Sends data as consecutive datagrams of segment_size bytes, the last one takes the remainder
+     * One sendmsg with a UDP_SEGMENT control message, segmentation happens as late as possible in
+     * the kernel or on the NIC instead of costing a trip through the stack per datagram
+     * The kernel caps a single send at 64 segments and 64 KiB, and rejects segments over the MTU
+     */
+    std::expected<size_t, error::ErrorCode> send_segmented(
+            const RefBuffer data, const uint16_t segment_size, const int flags = 0) const noexcept {
+        ::msghdr msg{};
+        return this->send_segmented(msg, data, segment_size, flags);
+    }
+    template<n3::net::AddressType U>
+    std::expected<size_t, error::ErrorCode> send_segmented(const RefBuffer data,
+            const uint16_t segment_size,
+            const U& dest,
+            const int flags = 0) const noexcept {
+        auto raw_addr = dest.to_sockaddr();
+        ::msghdr msg{};
+        msg.msg_name = &raw_addr;
+        msg.msg_namelen = sizeof(raw_addr);
+        return this->send_segmented(msg, data, segment_size, flags);
+    }
+
+private:
+    std::expected<size_t, error::ErrorCode> send_segmented(::msghdr& msg,
+            RefBuffer data,
+            const uint16_t segment_size,
+            const int flags) const noexcept;
+};
+
+} // namespace n3::net::linux::udp
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+#include "epoll_executor.h"
+#include "error.h"
+#include "handle.h"
+#include "socket.h"
+#include "syscalls.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("RefMultiBuffer consumes across buffer boundaries") {
+    std::array<std::byte, 4> a{};
+    std::array<std::byte, 8> b{};
+    std::array<std::byte, 2> c{};
+
+    n3::RefMultiBuffer multi{};
+    multi.push_back(std::span<std::byte>{a});
+    multi.push_back(std::span<std::byte>{b});
+    multi.push_back(std::span<std::byte>{c});
+    REQUIRE(multi.size() == 3);
+    REQUIRE(multi.size_bytes() == 14);
+
+    multi.consume(6);
+    REQUIRE(multi.size() == 2);
+    REQUIRE(multi.size_bytes() == 8);
+    REQUIRE(multi[0].data() == b.data() + 2);
+
+    multi.consume(8);
+    REQUIRE(multi.size() == 0);
+    REQUIRE(multi.size_bytes() == 0);
+}
+
+TEST_CASE("BufferQueue only fires callbacks once their push is fully consumed") {
+    std::array<std::byte, 4> header{};
+    std::array<std::byte, 16> body{};
+    std::array<std::byte, 4> trailer{};
+
+    std::vector<int> fired;
+    n3::BufferQueue queue{};
+    queue.push(std::span<std::byte>{header}, [&] { fired.push_back(1); });
+    n3::RefMultiBuffer rest{};
+    rest.push_back(std::span<std::byte>{body});
+    rest.push_back(std::span<std::byte>{trailer});
+    queue.push(rest, [&] { fired.push_back(2); });
+    REQUIRE(queue.size() == 3);
+    REQUIRE(queue.size_bytes() == 24);
+
+    queue.pop(2);
+    REQUIRE(fired.empty());
+    REQUIRE(queue.front().size() == 2);
+
+    //Finishes the header and part of the body, the second callback covers the trailer too
+    queue.pop(10);
+    REQUIRE((fired == std::vector<int>{1}));
+
+    queue.pop(12);
+    REQUIRE((fired == std::vector<int>{1, 2}));
+    REQUIRE(queue.empty());
+    REQUIRE(queue.size_bytes() == 0);
+}
+
+TEST_CASE("BufferQueue callbacks can push more data while being popped") {
+    std::array<std::byte, 8> first{};
+    std::array<std::byte, 8> second{};
+
+    n3::BufferQueue queue{};
+    bool second_fired = false;
+    queue.push(std::span<std::byte>{first}, [&] {
+        queue.push(std::span<std::byte>{second}, [&] { second_fired = true; });
+    });
+
+    queue.pop(8);
+    REQUIRE(queue.size() == 1);
+    REQUIRE(queue.front().data() == second.data());
+    REQUIRE(!second_fired);
+
+    queue.pop(8);
+    REQUIRE(second_fired);
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE("BufferQueue stays consistent across many partial pops") {
+    std::vector<std::array<std::byte, 3>> chunks(1000);
+    size_t fired = 0;
+
+    n3::BufferQueue queue{};
+    for (auto& chunk : chunks) {
+        queue.push(std::span<std::byte>{chunk}, [&] { ++fired; });
+    }
+    REQUIRE(queue.size_bytes() == 3000);
+
+    //Two bytes at a time never lines up with a chunk boundary twice in a row
+    while (!queue.empty()) {
+        queue.pop(std::min<size_t>(2, queue.size_bytes()));
+    }
+    REQUIRE(fired == chunks.size());
+    REQUIRE(queue.size_bytes() == 0);
+}
+
+TEST_CASE("writev and readv split vectors longer than IOV_MAX") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    //One byte per buffer keeps the whole transfer well inside the pipe capacity
+    std::vector<std::byte> out(IOV_MAX + 10);
+    std::vector<std::byte> in(out.size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = static_cast<std::byte>(i);
+    }
+
+    n3::RefMultiBuffer out_bufs{};
+    n3::RefMultiBuffer in_bufs{};
+    for (size_t i = 0; i < out.size(); ++i) {
+        out_bufs.push_back(std::span<std::byte>{out}.subspan(i, 1));
+        in_bufs.push_back(std::span<std::byte>{in}.subspan(i, 1));
+    }
+
+    const auto written = n3::linux::writev(fds[1], out_bufs);
+    REQUIRE(written.has_value());
+    REQUIRE(*written == out.size());
+
+    const auto read = n3::linux::readv(fds[0], in_bufs);
+    REQUIRE(read.has_value());
+    REQUIRE(*read == in.size());
+    REQUIRE(in == out);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("page_arena packs pages into regions and reuses them") {
+    //No hugetlb, the pool is usually empty and this keeps the test deterministic
+    n3::page_arena arena{false};
+    const auto page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const auto per_region = n3::page_arena::REGION_SIZE / page_size;
+
+    std::vector<std::byte *> pages;
+    for (size_t i = 0; i < per_region + 1; ++i) {
+        auto *const page = arena.allocate();
+        REQUIRE(reinterpret_cast<uintptr_t>(page) % page_size == 0);
+        //Fault it in, the memory has to be writable
+        page[0] = std::byte{1};
+        page[page_size - 1] = std::byte{1};
+        pages.push_back(page);
+    }
+    REQUIRE(arena.region_count() == 2);
+    REQUIRE(arena.pages_in_use() == per_region + 1);
+
+    //LIFO reuse, the page just returned comes straight back
+    auto *const last = pages.back();
+    arena.deallocate(last);
+    REQUIRE(arena.allocate() == last);
+
+    for (auto *const page : pages) {
+        arena.deallocate(page);
+    }
+    REQUIRE(arena.pages_in_use() == 0);
+    arena.trim();
+
+    //Pages from a PageBuffer go back when it's destroyed
+    {
+        const n3::PageBuffer buf{arena};
+        REQUIRE(buf.data().size() == page_size);
+        REQUIRE(arena.pages_in_use() == 1);
+    }
+    REQUIRE(arena.pages_in_use() == 0);
+}
+
+TEST_CASE("page_arena returns each page to the region it came from") {
+    n3::page_arena arena{false};
+    const auto page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    const auto per_region = n3::page_arena::REGION_SIZE / page_size;
+
+    std::vector<std::byte *> pages;
+    for (size_t i = 0; i < per_region * 3; ++i) {
+        pages.push_back(arena.allocate());
+    }
+    REQUIRE(arena.region_count() == 3);
+
+    //Regions are aligned to their size, which is what lets a page be mapped back by masking
+    const auto region_of = [](const std::byte *const page) {
+        return reinterpret_cast<uintptr_t>(page) & ~(n3::page_arena::REGION_SIZE - 1);
+    };
+    const auto kept = region_of(pages[per_region]);
+    REQUIRE(std::ranges::count_if(pages, [&](auto *const page) { return region_of(page) == kept; })
+            == static_cast<std::ptrdiff_t>(per_region));
+
+    //Free two of the regions in interleaved order, the third stays fully used
+    for (size_t i = 0; i < per_region; ++i) {
+        arena.deallocate(pages[i]);
+        arena.deallocate(pages[(per_region * 2) + i]);
+    }
+    REQUIRE(arena.pages_in_use() == per_region);
+
+    //Both freed regions take their pages back, so refilling them needs no new mapping
+    for (size_t i = 0; i < per_region * 2; ++i) {
+        auto *const page = arena.allocate();
+        REQUIRE(region_of(page) != kept);
+        pages[i < per_region ? i : per_region + i] = page;
+    }
+    REQUIRE(arena.region_count() == 3);
+
+    for (auto *const page : pages) {
+        arena.deallocate(page);
+    }
+    REQUIRE(arena.pages_in_use() == 0);
+}
+
+TEST_CASE("RingBuffer keeps wrapped data contiguous") {
+    n3::RingBuffer ring{1};
+    const auto cap = ring.capacity();
+    REQUIRE(cap == static_cast<size_t>(::sysconf(_SC_PAGESIZE)));
+    REQUIRE(ring.empty());
+    REQUIRE(ring.writable().size() == cap);
+
+    //Leave the head 100 bytes short of the end so the next receive wraps
+    ring.commit(cap - 100);
+    ring.consume(cap - 100);
+    REQUIRE(ring.empty());
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    std::vector<std::byte> sent(300);
+    for (size_t i = 0; i < sent.size(); ++i) {
+        sent[i] = static_cast<std::byte>(i);
+    }
+    REQUIRE(::write(fds[1], sent.data(), sent.size()) == 300);
+
+    const auto space = ring.writable();
+    REQUIRE(space.size() == cap);
+    const auto got = ::read(fds[0], space.data(), space.size());
+    REQUIRE(got == 300);
+    ring.commit(static_cast<size_t>(got));
+
+    //One span straddling the wrap point, no copy needed
+    const auto data = ring.readable();
+    REQUIRE(data.size() == 300);
+    REQUIRE(std::ranges::equal(data, sent));
+
+    ring.consume(150);
+    REQUIRE(std::ranges::equal(ring.readable(), std::span{sent}.subspan(150)));
+    REQUIRE(ring.writable().size() == cap - 150);
+
+    ring.commit(cap - 150);
+    REQUIRE(ring.full());
+    REQUIRE(ring.writable().empty());
+
+    const auto moved = std::move(ring);
+    REQUIRE(moved.size() == cap);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("socket send gathers mixed arguments into one sendmsg") {
+    struct plain_socket : n3::net::linux::socket<plain_socket> {};
+
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+    const uint8_t type = 7;
+    const uint32_t length = 0xdeadbeef;
+    const std::string body = "Some longer string of text";
+    const std::array<uint16_t, 2> trailer{1, 2};
+    std::array<std::byte, 4> raw{};
+    const n3::RefBuffer extra = std::span<std::byte>{raw};
+
+    const auto iovecs = n3::gather(type, length, body, trailer, extra);
+    static_assert(iovecs.size() == 5);
+    REQUIRE(iovecs[0].iov_len == 1);
+    REQUIRE(iovecs[1].iov_len == 4);
+    REQUIRE(iovecs[2].iov_base == body.data());
+    REQUIRE(iovecs[2].iov_len == body.size());
+    REQUIRE(iovecs[3].iov_len == 4);
+    REQUIRE(iovecs[4].iov_base == raw.data());
+
+    //Queued on the executor but not flushed yet, the gathered send must not overtake it
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(fds[0]).has_value());
+    std::string queued = "queued:";
+    size_t queued_sent = 0;
+    exec.send(fds[0], std::span{queued}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        queued_sent = res.value_or(0);
+    });
+
+    const plain_socket sock{};
+    const auto sent = sock.send(exec, fds[0], type, length, std::string_view{body}, trailer);
+    REQUIRE(sent.has_value());
+    REQUIRE(*sent == 1 + 4 + body.size() + 4);
+    REQUIRE(queued_sent == queued.size());
+
+    std::array<std::byte, 64> got{};
+    REQUIRE(::read(fds[1], got.data(), got.size())
+            == static_cast<ssize_t>(queued.size() + *sent));
+    REQUIRE(std::memcmp(got.data(), queued.data(), queued.size()) == 0);
+    const auto *const parts = got.data() + queued.size();
+    REQUIRE(parts[0] == std::byte{7});
+    uint32_t got_length = 0;
+    std::memcpy(&got_length, parts + 1, sizeof(got_length));
+    REQUIRE(got_length == length);
+    REQUIRE(std::memcmp(parts + 5, body.data(), body.size()) == 0);
+    REQUIRE(exec.remove(fds[0]).has_value());
+
+    static_assert(!n3::GatherPart<const char *>);
+    static_assert(!n3::GatherPart<char[4]>);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("socket send from a send callback follows the flush that ran it") {
+    struct plain_socket : n3::net::linux::socket<plain_socket> {};
+
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+    const plain_socket sock{};
+    const uint16_t hdr = 4;
+
+    //Everything queued went out, the next message can go straight to the socket
+    std::string first = "first";
+    std::expected<size_t, n3::error::ErrorCode> next_sent
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    exec.send(lhs, std::span{first}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        REQUIRE(res.has_value());
+        next_sent = sock.send(exec, lhs, hdr, std::string_view{"next"});
+    });
+    exec.run_once(0ms);
+    REQUIRE(next_sent == sizeof(hdr) + 4);
+
+    std::array<char, 64> got{};
+    REQUIRE(::read(rhs, got.data(), got.size())
+            == static_cast<ssize_t>(first.size() + sizeof(hdr) + 4));
+    REQUIRE(std::string_view{got.data(), first.size()} == first);
+    REQUIRE(std::string_view{got.data() + first.size() + sizeof(hdr), 4} == "next");
+
+    //Part of a later buffer is still queued, so the gathered send has to wait its turn
+    std::string big(4 << 20, 'b');
+    std::expected<size_t, n3::error::ErrorCode> big_sent{};
+    exec.send(lhs, std::span{first}, [&](std::expected<size_t, n3::error::ErrorCode>) {
+        next_sent = sock.send(exec, lhs, hdr, std::string_view{"next"});
+    });
+    exec.send(lhs, std::span{big}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        big_sent = res;
+    });
+    exec.run_once(0ms);
+    REQUIRE(!next_sent.has_value());
+    REQUIRE(next_sent.error() == n3::error::posix_error::eagain);
+
+    //The queue survived the nested call, removing the handle cancels what's left of it
+    REQUIRE(exec.remove(lhs).has_value());
+    REQUIRE(!big_sent.has_value());
+    REQUIRE(big_sent.error() == n3::error::posix_error::ecanceled);
+}
@@ -0,0 +1,95 @@
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "callbacks.h"
+
+namespace {
+//Counts live copies so the tests can see exactly when the capture is destroyed
+struct tracked {
+    int *live;
+
+    explicit tracked(int *counter) noexcept : live{counter} {
+        ++*this->live;
+    }
+    tracked(tracked&& other) noexcept : live{other.live} {
+        ++*this->live;
+    }
+    tracked& operator=(tracked&&) = delete;
+    ~tracked() {
+        --*this->live;
+    }
+};
+} // namespace
+
+TEST_CASE("callback stores small captures inline") {
+    static_assert(sizeof(n3::callback<void>) <= n3::CALLBACK_INLINE_BYTES + sizeof(void *) * 2);
+
+    int live = 0;
+    int result = 0;
+    {
+        n3::callback<int> cb{[t = tracked{&live}, &result](int value) { result = value; }};
+        REQUIRE(live == 1);
+
+        //Moves relocate the capture, the source is left empty
+        auto moved = std::move(cb);
+        REQUIRE(live == 1);
+
+        std::move(moved)(42);
+        REQUIRE(result == 42);
+        //One-shot, the capture is gone as soon as it has run
+        REQUIRE(live == 0);
+    }
+    REQUIRE(live == 0);
+}
+
+TEST_CASE("callback binds leading arguments") {
+    int sum = 0;
+    n3::callback<int> cb{[&sum](int a, int b) { sum = a + b; }, 40};
+    std::move(cb)(2);
+    REQUIRE(sum == 42);
+}
+
+TEST_CASE("callback destroys an unused capture") {
+    int live = 0;
+    {
+        n3::callback<void> cb{[t = tracked{&live}] {}};
+        REQUIRE(live == 1);
+    }
+    REQUIRE(live == 0);
+}
+
+TEST_CASE("callback heap fallback holds oversized captures") {
+    std::array<std::byte, n3::CALLBACK_INLINE_BYTES * 2> big{};
+    big[0] = std::byte{7};
+
+    int live = 0;
+    std::byte seen{};
+    n3::callback<void> cb{n3::heap_allocate, [big, t = tracked{&live}, &seen] { seen = big[0]; }};
+    REQUIRE(live == 1);
+
+    auto moved = std::move(cb);
+    std::move(moved)();
+    REQUIRE(seen == std::byte{7});
+    REQUIRE(live == 0);
+}
+
+#ifdef N3_CALLBACK_DIAGNOSTICS
+TEST_CASE("callback diagnostics record capture sizes") {
+    n3::reset_callback_stats();
+
+    int value = 0;
+    n3::callback<void> small{[&value] { ++value; }};
+    std::array<std::byte, n3::CALLBACK_INLINE_BYTES * 2> big{};
+    n3::callback<void> boxed{n3::heap_allocate, [big] { (void) big; }};
+
+    const auto stats = n3::callback_stats();
+    REQUIRE(stats.created == 2);
+    REQUIRE(stats.heap == 1);
+    REQUIRE(stats.largest == sizeof(big));
+    REQUIRE(stats.by_size[1] == 1);
+    REQUIRE(stats.by_size.back() == 1);
+}
+#endif
@@ -0,0 +1,457 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <malloc.h>
+#include <span>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "epoll_executor.h"
+#include "frame_allocator.h"
+#include "handle.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+n3::linux::epoll::EpollTask wait_readable(n3::linux::epoll::epoll_executor& exec,
+        const n3::Handle fd,
+        std::expected<void, n3::error::ErrorCode>& out) {
+    out = co_await exec.readable(fd);
+}
+
+n3::linux::epoll::EpollTask recv_pooled(n3::linux::epoll::epoll_executor& exec,
+        const n3::Handle fd,
+        n3::linux::epoll::recv_buffer_pool& pool,
+        std::expected<n3::linux::epoll::pooled_buffer, n3::error::ErrorCode>& out) {
+    out = co_await exec.recv(fd, pool);
+}
+
+n3::linux::epoll::EpollTask noop_task() {
+    co_return;
+}
+
+//Frees its frame from a thread_local destructor that runs after the thread's frame pool is gone
+struct late_frame {
+    void *frame = nullptr;
+
+    ~late_frame() {
+        if (this->frame) {
+            n3::deallocate_frame(this->frame, 128);
+        }
+    }
+};
+
+thread_local late_frame late;
+
+} // namespace
+
+TEST_CASE("EpollTask frames are recycled through the thread's frame pool") {
+    //Warm the size class so the loop below never needs operator new
+    { noop_task(); }
+    n3::reset_thread_frame_stats();
+
+    for (int i = 0; i < 100; ++i) {
+        auto task = noop_task();
+        task.start();
+        REQUIRE(task.done());
+    }
+
+    const auto stats = n3::thread_frame_stats();
+    REQUIRE(stats.allocations == 100);
+    REQUIRE(stats.reused == 100);
+    REQUIRE(stats.unpooled == 0);
+    REQUIRE(stats.live == 0);
+    REQUIRE(stats.peak_live == 1);
+}
+
+TEST_CASE("frames freed after the thread's frame pool is destroyed skip the freelist") {
+    bool allocated = false;
+    std::jthread{[&] {
+        //Constructed before the pool, so destroyed after it at thread exit
+        auto& holder = late;
+        holder.frame = n3::allocate_frame(128);
+        allocated = holder.frame != nullptr;
+    }}.join();
+    //A frame pushed onto the dead pool's freelist would leak, which the leak checker reports
+    REQUIRE(allocated);
+}
+
+TEST_CASE("epoll_token rejects events for a reused fd") {
+    n3::linux::epoll::handle_table table{};
+
+    auto& slot = table.acquire(7);
+    const n3::linux::epoll::epoll_token token{.slot = &slot, .generation = slot.generation};
+    const auto raw = token.pack();
+
+    const auto unpacked = n3::linux::epoll::epoll_token::unpack(raw);
+    REQUIRE(unpacked.slot == &slot);
+    REQUIRE(unpacked.generation == token.generation);
+    REQUIRE(!unpacked.is_stale());
+
+    //Removed, so an event still in flight for it is dropped
+    table.release(slot);
+    REQUIRE(table.find(7) == nullptr);
+    REQUIRE(n3::linux::epoll::epoll_token::unpack(raw).is_stale());
+
+    //The same fd comes back in the same slot, only the generation tells the two apart
+    auto& reused = table.acquire(7);
+    REQUIRE(&reused == &slot);
+    REQUIRE(n3::linux::epoll::epoll_token::unpack(raw).is_stale());
+
+    const n3::linux::epoll::epoll_token fresh{.slot = &reused, .generation = reused.generation};
+    REQUIRE(fresh.generation != token.generation);
+    REQUIRE(!n3::linux::epoll::epoll_token::unpack(fresh.pack()).is_stale());
+}
+
+TEST_CASE("epoll_executor resumes a coroutine waiting for readability") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+
+    //Drain the initial writable edge so only the read below is pending
+    exec.run_once(0ms);
+
+    std::expected<void, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = wait_readable(exec, lhs, result);
+    task.start();
+    REQUIRE(!task.done());
+
+    const char byte = 'x';
+    REQUIRE(::write(rhs, &byte, 1) == 1);
+    exec.run_once(100ms);
+
+    REQUIRE(task.done());
+    REQUIRE(result.has_value());
+}
+
+TEST_CASE("epoll_executor latency mode delivers events without outspinning the timeout") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    //Spin budget far beyond every timeout below, so only the clamp keeps run_once short
+    [[maybe_unused]] const auto mode = exec.enable_latency_mode({.spin = 2s});
+    REQUIRE(exec.add(lhs).has_value());
+    exec.run_once(0ms);
+
+    //Nothing pending, a poll returns straight away and a short timeout bounds the spin
+    auto start = std::chrono::steady_clock::now();
+    exec.run_once(0ms);
+    REQUIRE(std::chrono::steady_clock::now() - start < 500ms);
+    start = std::chrono::steady_clock::now();
+    exec.run_once(10ms);
+    REQUIRE(std::chrono::steady_clock::now() - start < 500ms);
+
+    std::expected<void, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = wait_readable(exec, lhs, result);
+    task.start();
+    REQUIRE(!task.done());
+
+    const char byte = 'x';
+    REQUIRE(::write(rhs, &byte, 1) == 1);
+    exec.run_once(1s);
+
+    REQUIRE(task.done());
+    REQUIRE(result.has_value());
+}
+
+TEST_CASE("epoll_executor cancels waiters of removed handles") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+
+    std::expected<void, n3::error::ErrorCode> result{};
+    auto task = wait_readable(exec, lhs, result);
+    task.start();
+    REQUIRE(!task.done());
+
+    REQUIRE(exec.remove(lhs).has_value());
+    REQUIRE(task.done());
+    REQUIRE(!result.has_value());
+    REQUIRE(result.error() == n3::error::posix_error::ecanceled);
+}
+
+TEST_CASE("epoll_executor coalesces queued sends into one flush") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+
+    std::string header = "HDR:";
+    std::string body(4096, 'b');
+    std::string trailer = ":END";
+
+    std::vector<size_t> completed;
+    const auto on_sent = [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        REQUIRE(res.has_value());
+        completed.push_back(*res);
+    };
+    exec.send(lhs, std::span{header}, on_sent);
+    exec.send(lhs, std::span{body}, on_sent);
+    exec.send(lhs, std::span{trailer}, on_sent);
+
+    //Nothing goes out until the executor flushes
+    REQUIRE(completed.empty());
+    exec.run_once(0ms);
+    REQUIRE((completed == std::vector<size_t>{header.size(), body.size(), trailer.size()}));
+
+    std::string received(header.size() + body.size() + trailer.size(), '\0');
+    REQUIRE(::read(rhs, received.data(), received.size())
+            == static_cast<ssize_t>(received.size()));
+    REQUIRE(received == header + body + trailer);
+}
+
+TEST_CASE("epoll_executor cancels only the unsent part when a send callback removes its handle") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+
+    std::string first(300, 'a');
+    std::string second(300, 'b');
+    //Far more than the socket buffer takes, so the flush ends partway into it
+    std::string third(4 << 20, 'c');
+
+    std::vector<std::expected<size_t, n3::error::ErrorCode>> results(3);
+    exec.send(lhs, std::span{first}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        results[0] = res;
+        REQUIRE(exec.remove(lhs).has_value());
+    });
+    exec.send(lhs, std::span{second}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        results[1] = res;
+    });
+    exec.send(lhs, std::span{third}, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        results[2] = res;
+    });
+    exec.run_once(0ms);
+
+    //The second buffer went out in the same write as the first, only the third is cut short
+    REQUIRE(results[0] == first.size());
+    REQUIRE(results[1] == second.size());
+    REQUIRE(!results[2].has_value());
+    REQUIRE(results[2].error() == n3::error::posix_error::ecanceled);
+
+    std::string received;
+    std::vector<char> chunk(64 * 1024);
+    ssize_t n = 0;
+    while ((n = ::read(rhs, chunk.data(), chunk.size())) > 0) {
+        received.append(chunk.data(), static_cast<size_t>(n));
+    }
+    REQUIRE(received.size() > first.size() + second.size());
+    REQUIRE(received.size() < first.size() + second.size() + third.size());
+    REQUIRE(received.starts_with(first + second));
+}
+
+TEST_CASE("epoll_executor dirties re-added handles next to stale tokens") {
+    constexpr size_t HANDLES = 16;
+
+    n3::linux::epoll::epoll_executor exec{};
+    std::vector<n3::OwnedHandle> lhs;
+    std::vector<n3::OwnedHandle> rhs;
+    lhs.reserve(HANDLES);
+    rhs.reserve(HANDLES);
+    for (size_t i = 0; i < HANDLES; ++i) {
+        int fds[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+        lhs.emplace_back(fds[0]);
+        rhs.emplace_back(fds[1]);
+        REQUIRE(exec.add(lhs.back()).has_value());
+    }
+
+    size_t cancelled = 0;
+    size_t sent = 0;
+    const auto on_sent = [&](std::expected<size_t, n3::error::ErrorCode> res) {
+        if (res.has_value()) {
+            sent += *res;
+        } else {
+            ++cancelled;
+        }
+    };
+    std::string byte = "x";
+
+    //Every handle is dirtied, then removed and re-added before the flush, so the dirty list
+    //holds a stale token and a live one for each fd
+    for (const auto& fd : lhs) {
+        exec.send(fd, std::span{byte}, on_sent);
+    }
+    for (const auto& fd : lhs) {
+        REQUIRE(exec.remove(fd).has_value());
+        REQUIRE(exec.add(fd).has_value());
+        exec.send(fd, std::span{byte}, on_sent);
+    }
+    exec.run_once(0ms);
+
+    REQUIRE(cancelled == HANDLES);
+    REQUIRE(sent == HANDLES);
+    for (const auto& fd : rhs) {
+        char received[2]{};
+        REQUIRE(::read(fd, received, sizeof(received)) == 1);
+    }
+}
+
+TEST_CASE("epoll_executor idle connections cost one table slot") {
+    constexpr size_t CONNECTIONS = 256;
+
+    n3::linux::epoll::epoll_executor exec{};
+    std::vector<n3::OwnedHandle> handles;
+    handles.reserve(CONNECTIONS * 2);
+
+    const auto open_pair = [&] {
+        int fds[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+        handles.emplace_back(fds[0]);
+        handles.emplace_back(fds[1]);
+        return fds[0];
+    };
+
+    //First add allocates the table chunk the rest of the fds land in
+    REQUIRE(exec.add(open_pair()).has_value());
+    std::vector<int> idle;
+    idle.reserve(CONNECTIONS);
+    for (size_t i = 0; i < CONNECTIONS; ++i) {
+        idle.push_back(open_pair());
+    }
+
+    //No assertions inside the measured window, they may allocate themselves
+    bool added = true;
+    const auto before = ::mallinfo2().uordblks;
+    for (const auto fd : idle) {
+        added = exec.add(fd).has_value() && added;
+    }
+    const auto heap_growth = ::mallinfo2().uordblks - before;
+    REQUIRE(added);
+
+    const size_t bytes_per_idle
+            = sizeof(n3::linux::epoll::epoll_handle_state) + heap_growth / CONNECTIONS;
+    REQUIRE(heap_growth == 0);
+    REQUIRE(bytes_per_idle <= 64);
+    REQUIRE(exec.tx_queues_in_use() == 0);
+
+    //A send borrows a queue only until it drains
+    std::string payload = "ping";
+    bool sent = false;
+    exec.send(idle.front(),
+            std::span{payload},
+            [&](std::expected<size_t, n3::error::ErrorCode> res) { sent = res.has_value(); });
+    REQUIRE(exec.tx_queues_in_use() == 1);
+    exec.run_once(0ms);
+    REQUIRE(sent);
+    REQUIRE(exec.tx_queues_in_use() == 0);
+}
+
+TEST_CASE("epoll_executor lends receive buffers only once data arrives") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+    exec.run_once(0ms);
+
+    n3::linux::epoll::recv_buffer_pool pool{2, 64};
+    std::expected<n3::linux::epoll::pooled_buffer, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = recv_pooled(exec, lhs, pool, result);
+    task.start();
+
+    //Parked waiting for data, nothing borrowed yet
+    REQUIRE(!task.done());
+    REQUIRE(pool.available() == 2);
+
+    const std::string payload = "hello";
+    REQUIRE(::write(rhs, payload.data(), payload.size())
+            == static_cast<ssize_t>(payload.size()));
+    exec.run_once(100ms);
+
+    REQUIRE(task.done());
+    REQUIRE(result.has_value());
+    REQUIRE(pool.available() == 1);
+    const auto data = result->data();
+    REQUIRE(std::string(reinterpret_cast<const char *>(data.data()), data.size()) == payload);
+
+    result->release();
+    REQUIRE(pool.available() == 2);
+}
+
+TEST_CASE("epoll_executor pooled recv hands back readiness only once a buffer is free") {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+    const n3::OwnedHandle lhs{fds[0]};
+    const n3::OwnedHandle rhs{fds[1]};
+
+    n3::linux::epoll::epoll_executor exec{};
+    REQUIRE(exec.add(lhs).has_value());
+    exec.run_once(0ms);
+
+    const auto as_string = [](const n3::linux::epoll::pooled_buffer& buf) {
+        const auto data = buf.data();
+        return std::string(reinterpret_cast<const char *>(data.data()), data.size());
+    };
+    const auto send_peer = [&](const std::string& payload) {
+        REQUIRE(::write(rhs, payload.data(), payload.size())
+                == static_cast<ssize_t>(payload.size()));
+        exec.run_once(100ms);
+    };
+    using recv_result = std::expected<n3::linux::epoll::pooled_buffer, n3::error::ErrorCode>;
+
+    n3::linux::epoll::recv_buffer_pool pool{1, 64};
+    recv_result held = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    send_peer("one");
+    recv_pooled(exec, lhs, pool, held).start();
+    REQUIRE(held.has_value());
+    REQUIRE(pool.available() == 0);
+
+    //Data is waiting but every buffer is lent out
+    send_peer("two");
+    recv_result starved = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    recv_pooled(exec, lhs, pool, starved).start();
+    REQUIRE(!starved.has_value());
+    REQUIRE(starved.error() == n3::error::posix_error::enobufs);
+
+    //Retrying against the still empty pool parks instead of failing straight away again
+    recv_result parked = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto parked_task = recv_pooled(exec, lhs, pool, parked);
+    parked_task.start();
+    REQUIRE(!parked_task.done());
+
+    held->release();
+    send_peer("three");
+    REQUIRE(parked_task.done());
+    REQUIRE(parked.has_value());
+    REQUIRE(as_string(*parked) == "twothree");
+
+    //Starved again, but this time the retry comes after a release, no new edge needed
+    send_peer("four");
+    recv_pooled(exec, lhs, pool, starved).start();
+    REQUIRE(!starved.has_value());
+    parked->release();
+
+    recv_result retried = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto retried_task = recv_pooled(exec, lhs, pool, retried);
+    retried_task.start();
+    REQUIRE(retried_task.done());
+    REQUIRE(retried.has_value());
+    REQUIRE(as_string(*retried) == "four");
+}
@@ -0,0 +1,92 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <type_traits>
+
+#include "error.h"
+#include "executor.h"
+
+namespace {
+
+//Sets N3_BACKEND for the scope of one test, the selection is only read when an executor is built
+class backend_env {
+public:
+    explicit backend_env(const char *const value) {
+        REQUIRE(::setenv("N3_BACKEND", value, 1) == 0);
+    }
+    ~backend_env() {
+        ::unsetenv("N3_BACKEND");
+    }
+
+    backend_env(const backend_env&) = delete;
+    backend_env& operator=(const backend_env&) = delete;
+};
+
+} // namespace
+
+TEST_CASE("executor honours a forced epoll backend") {
+    n3::linux::executor exec{n3::linux::backend::epoll};
+    REQUIRE(exec.active_backend() == n3::linux::backend::epoll);
+
+    const bool is_epoll = exec.visit([]<typename T>(T&) {
+        return std::is_same_v<T, n3::linux::epoll::epoll_executor>;
+    });
+    REQUIRE(is_epoll);
+}
+
+TEST_CASE("executor automatic selection agrees with the kernel probe") {
+    const auto features = n3::linux::probe_kernel();
+    n3::linux::executor exec{};
+
+    //io_uring can still fail past the probe (seccomp, memlock), but never the other way around
+    if (!features.io_uring) {
+        REQUIRE(exec.active_backend() == n3::linux::backend::epoll);
+    }
+    REQUIRE(exec.active_backend() != n3::linux::backend::automatic);
+}
+
+TEST_CASE("kernel probe only reports what the executor can build on") {
+    const auto features = n3::linux::probe_kernel();
+
+    //Multishot recv draws from a buffer ring, and the io_uring backend needs both
+    if (features.multishot_recv) {
+        REQUIRE(features.buf_ring);
+    }
+    if (features.io_uring) {
+        REQUIRE(features.buf_ring);
+    }
+    if (features.defer_taskrun) {
+        REQUIRE(features.single_issuer);
+    }
+}
+
+TEST_CASE("executor honours N3_BACKEND=epoll") {
+    const backend_env env{"epoll"};
+    REQUIRE(n3::linux::backend_from_env() == n3::linux::backend::epoll);
+
+    n3::linux::executor exec{};
+    REQUIRE(exec.active_backend() == n3::linux::backend::epoll);
+}
+
+TEST_CASE("executor honours N3_BACKEND=io_uring") {
+    const backend_env env{"io_uring"};
+    REQUIRE(n3::linux::backend_from_env() == n3::linux::backend::io_uring);
+
+    //A forced backend throws instead of falling back, so only a usable kernel can be checked
+    if (!n3::linux::probe_kernel().io_uring) {
+        SKIP("io_uring is unavailable");
+    }
+    try {
+        n3::linux::executor exec{};
+        REQUIRE(exec.active_backend() == n3::linux::backend::io_uring);
+    } catch (const n3::error::ErrorCode&) {
+        SKIP("io_uring can't be set up here");
+    }
+}
+
+TEST_CASE("executor ignores an unrecognised N3_BACKEND") {
+    const backend_env env{"kqueue"};
+    REQUIRE(!n3::linux::backend_from_env().has_value());
+
+    n3::linux::executor exec{};
+    REQUIRE(exec.active_backend() != n3::linux::backend::automatic);
+}
@@ -0,0 +1,673 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <malloc.h>
+#include <memory>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "address.h"
+#include "buffer.h"
+#include "error.h"
+#include "handle.h"
+#include "io_uring.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+namespace uring = n3::linux::io_uring;
+
+//Kernels without io_uring, or sandboxes that block it, skip instead of failing
+std::unique_ptr<uring::Executor> make_executor(const uring::ring_config& config = {}) {
+    try {
+        return std::make_unique<uring::Executor>(config);
+    } catch (const n3::error::ErrorCode&) {
+        SKIP("io_uring is unavailable");
+    }
+    return nullptr;
+}
+
+std::array<int, 2> open_pair() {
+    std::array<int, 2> fds{};
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds.data()) == 0);
+    return fds;
+}
+
+struct socket_pair {
+    std::array<int, 2> fds{open_pair()};
+    n3::OwnedHandle lhs{fds[0]};
+    n3::OwnedHandle rhs{fds[1]};
+};
+
+uring::Task recv_into(uring::Executor& exec,
+        const n3::Handle fd,
+        n3::RefBuffer buf,
+        std::expected<size_t, n3::error::ErrorCode>& out) {
+    out = co_await exec.recv(fd, buf);
+}
+
+//Runs the executor until the task finishes, bounded so a lost completion fails instead of hanging
+void run_until_done(uring::Executor& exec, const uring::Task& task) {
+    for (int i = 0; i < 100 && !task.done(); ++i) {
+        exec.run_once();
+    }
+    REQUIRE(task.done());
+}
+
+} // namespace
+
+TEST_CASE("io_uring Executor resumes a coroutine with received data") {
+    const auto exec = make_executor();
+    const socket_pair sockets{};
+
+    std::array<std::byte, 64> storage{};
+    std::expected<size_t, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = recv_into(*exec, sockets.lhs, std::span<std::byte>{storage}, result);
+    task.start();
+    REQUIRE(!task.done());
+
+    const std::string payload = "hello";
+    REQUIRE(::write(sockets.rhs, payload.data(), payload.size())
+            == static_cast<ssize_t>(payload.size()));
+    run_until_done(*exec, task);
+
+    REQUIRE(result.has_value());
+    REQUIRE(*result == payload.size());
+    REQUIRE(std::string(reinterpret_cast<const char *>(storage.data()), *result) == payload);
+}
+
+TEST_CASE("io_uring Executor reports callback sends through the pooled operations") {
+    const auto exec = make_executor();
+    const socket_pair sockets{};
+
+    std::string payload = "ping";
+    size_t completed = 0;
+    const auto send_one = [&] {
+        exec->send(sockets.lhs,
+                std::span{payload},
+                0,
+                [&](std::expected<size_t, n3::error::ErrorCode> res) {
+                    completed += (res.has_value() && *res == payload.size());
+                });
+        exec->run_once();
+    };
+
+    //First send grows the pool, every later one reuses that same operation
+    send_one();
+    REQUIRE(completed == 1);
+
+    constexpr size_t ROUNDS = 64;
+    const auto before = ::mallinfo2().uordblks;
+    for (size_t i = 0; i < ROUNDS; ++i) {
+        send_one();
+    }
+    const auto heap_growth = ::mallinfo2().uordblks - before;
+    REQUIRE(completed == ROUNDS + 1);
+    REQUIRE(heap_growth == 0);
+
+    std::string received((ROUNDS + 1) * payload.size(), '\0');
+    REQUIRE(::read(sockets.rhs, received.data(), received.size())
+            == static_cast<ssize_t>(received.size()));
+}
+
+TEST_CASE("io_uring Executor callback recv completes once data arrives") {
+    const auto exec = make_executor();
+    const socket_pair sockets{};
+
+    std::array<std::byte, 16> storage{};
+    std::optional<std::expected<size_t, n3::error::ErrorCode>> result;
+    exec->recv(sockets.lhs,
+            std::span<std::byte>{storage},
+            0,
+            [&](std::expected<size_t, n3::error::ErrorCode> res) { result = res; });
+
+    const char byte = 'x';
+    REQUIRE(::write(sockets.rhs, &byte, 1) == 1);
+    for (int i = 0; i < 100 && !result; ++i) {
+        exec->run_once();
+    }
+    REQUIRE(result.has_value());
+    REQUIRE(result->has_value());
+    REQUIRE(**result == 1);
+    REQUIRE(storage[0] == std::byte{'x'});
+}
+
+TEST_CASE("io_uring Executor stop() interrupts a blocked run from another thread") {
+    const auto exec = make_executor();
+
+    //Nothing is in flight, run() blocks in io_uring_enter until the wakeup
+    std::jthread stopper{[&] {
+        std::this_thread::sleep_for(50ms);
+        exec->stop();
+    }};
+    exec->run();
+    REQUIRE(!exec->is_active());
+}
+
+namespace {
+
+uring::Task drain_stream(uring::multishot_recv& stream, std::string& out, size_t& chunks) {
+    while (true) {
+        const auto item = co_await stream.next();
+        if (!item.has_value() || item->empty()) {
+            co_return;
+        }
+        const auto data = item->data();
+        out.append(reinterpret_cast<const char *>(data.data()), data.size());
+        ++chunks;
+        //The view goes out of scope here, which hands the buffer back to the ring
+    }
+}
+
+} // namespace
+
+TEST_CASE("io_uring multishot recv recycles ring buffers across many receives") {
+    const auto exec = make_executor();
+    const socket_pair sockets{};
+
+    //Far fewer ring buffers than receives, only recycling keeps the stream going
+    uring::buffer_ring ring{exec->ring(), 0, 2, 64};
+    uring::multishot_recv stream{*exec, sockets.lhs, ring};
+    REQUIRE(stream.start().has_value());
+
+    std::string received;
+    size_t chunks = 0;
+    auto task = drain_stream(stream, received, chunks);
+    task.start();
+
+    std::string expected;
+    for (size_t i = 0; i < 16; ++i) {
+        const std::string chunk = "chunk" + std::to_string(i) + ";";
+        REQUIRE(::write(sockets.rhs, chunk.data(), chunk.size())
+                == static_cast<ssize_t>(chunk.size()));
+        expected += chunk;
+        for (int spin = 0; spin < 100 && chunks <= i; ++spin) {
+            exec->run_once();
+        }
+        REQUIRE(chunks == i + 1);
+    }
+    REQUIRE(received == expected);
+    REQUIRE(stream.is_armed());
+
+    stream.cancel();
+    for (int spin = 0; spin < 100 && stream.is_armed(); ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(!stream.is_armed());
+    REQUIRE(task.done());
+}
+
+TEST_CASE("io_uring multishot recv re-arms after the ring runs dry") {
+    const auto exec = make_executor();
+    const socket_pair sockets{};
+
+    uring::buffer_ring ring{exec->ring(), 0, 2, 64};
+    std::vector<uring::multishot_recv::item_type> items;
+    uring::multishot_recv stream{*exec, sockets.lhs, ring, [&](auto item) {
+                                     items.push_back(std::move(item));
+                                 }};
+    REQUIRE(stream.start().has_value());
+
+    const auto deliver = [&](const std::string& chunk, const size_t expected_items) {
+        REQUIRE(::write(sockets.rhs, chunk.data(), chunk.size())
+                == static_cast<ssize_t>(chunk.size()));
+        for (int spin = 0; spin < 100 && items.size() < expected_items; ++spin) {
+            exec->run_once();
+        }
+        REQUIRE(items.size() == expected_items);
+    };
+
+    //Both buffers stay held, so the third receive has nowhere to go
+    deliver("one", 1);
+    deliver("two", 2);
+    deliver("three", 3);
+    REQUIRE(items[0].has_value());
+    REQUIRE(items[1].has_value());
+    REQUIRE(!items[2].has_value());
+    REQUIRE(items[2].error() == n3::error::get_error_code_from_errno(ENOBUFS));
+    //That CQE came without IORING_CQE_F_MORE, the kernel dropped the request
+    REQUIRE(!stream.is_armed());
+
+    //Releasing the buffers and re-arming picks the data back up where it was left
+    items.clear();
+    REQUIRE(stream.start().has_value());
+    for (int spin = 0; spin < 100 && items.empty(); ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(items.size() == 1);
+    REQUIRE(items[0].has_value());
+    const auto data = items[0]->data();
+    REQUIRE(std::string(reinterpret_cast<const char *>(data.data()), data.size()) == "three");
+
+    stream.cancel();
+    for (int spin = 0; spin < 100 && stream.is_armed(); ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(!stream.is_armed());
+}
+
+TEST_CASE("io_uring multishot accept takes many connections from one SQE") {
+    constexpr size_t CLIENTS = 8;
+
+    const auto exec = make_executor();
+
+    const n3::OwnedHandle listener{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    REQUIRE(listener >= 0);
+    ::sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::bind(listener, reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(listener, SOMAXCONN) == 0);
+    socklen_t addr_len = sizeof(addr);
+    REQUIRE(::getsockname(listener, reinterpret_cast<::sockaddr *>(&addr), &addr_len) == 0);
+
+    std::vector<n3::OwnedHandle> accepted;
+    accepted.reserve(CLIENTS);
+    size_t failures = 0;
+    uring::multishot_accept acceptor{*exec, listener, [&](uring::multishot_accept::item_type item) {
+                                         if (item.has_value()) {
+                                             accepted.emplace_back(item->fd);
+                                         } else {
+                                             ++failures;
+                                         }
+                                     }};
+    REQUIRE(acceptor.start().has_value());
+
+    std::vector<n3::OwnedHandle> clients;
+    clients.reserve(CLIENTS);
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        clients.emplace_back(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        REQUIRE(::connect(clients.back(), reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr))
+                == 0);
+    }
+    for (int spin = 0; spin < 100 && accepted.size() < CLIENTS; ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(failures == 0);
+    REQUIRE(accepted.size() == CLIENTS);
+    //Still the same SQE, it was never re-armed
+    REQUIRE(acceptor.is_armed());
+
+    //The peer address is only looked up on request, and matches the client's end
+    ::sockaddr_in client_addr{};
+    socklen_t client_len = sizeof(client_addr);
+    REQUIRE(::getsockname(
+                    clients.front(), reinterpret_cast<::sockaddr *>(&client_addr), &client_len)
+            == 0);
+    const auto peer = uring::accepted_socket{accepted.front()}.peer();
+    REQUIRE(peer.has_value());
+    REQUIRE(std::holds_alternative<n3::net::v4::address>(*peer));
+    REQUIRE(std::get<n3::net::v4::address>(*peer).to_sockaddr().sin_port == client_addr.sin_port);
+
+    acceptor.cancel();
+    for (int spin = 0; spin < 100 && acceptor.is_armed(); ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(!acceptor.is_armed());
+}
+
+namespace {
+
+uring::Task accept_and_recv(uring::Executor& exec,
+        const n3::Handle listener,
+        n3::RefBuffer buf,
+        std::optional<uring::file_ref>& conn,
+        std::expected<size_t, n3::error::ErrorCode>& out) {
+    //Flags a regular accept would use, SOCK_CLOEXEC has no meaning for a direct descriptor
+    auto accepted = co_await exec.accept_direct(listener, SOCK_CLOEXEC);
+    if (!accepted.has_value()) {
+        out = std::unexpected(accepted.error());
+        co_return;
+    }
+    conn = accepted->first;
+    out = co_await exec.recv(accepted->first, buf);
+}
+
+} // namespace
+
+TEST_CASE("io_uring accept_direct installs the connection in the fixed file table") {
+    const auto exec = make_executor();
+
+    const n3::OwnedHandle listener{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    REQUIRE(listener >= 0);
+    ::sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::bind(listener, reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(listener, SOMAXCONN) == 0);
+    socklen_t addr_len = sizeof(addr);
+    REQUIRE(::getsockname(listener, reinterpret_cast<::sockaddr *>(&addr), &addr_len) == 0);
+
+    std::array<std::byte, 16> storage{};
+    std::optional<uring::file_ref> conn;
+    std::expected<size_t, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = accept_and_recv(*exec, listener, std::span<std::byte>{storage}, conn, result);
+    task.start();
+
+    const n3::OwnedHandle client{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    REQUIRE(::connect(client, reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) == 0);
+    const std::string payload = "direct";
+    REQUIRE(::write(client, payload.data(), payload.size())
+            == static_cast<ssize_t>(payload.size()));
+    run_until_done(*exec, task);
+
+    REQUIRE(result.has_value());
+    REQUIRE(conn.has_value());
+    REQUIRE(conn->fixed);
+    REQUIRE(std::string(reinterpret_cast<const char *>(storage.data()), *result) == payload);
+    REQUIRE(exec->close_direct(*conn).has_value());
+}
+
+namespace {
+
+//Connected loopback TCP pair, zero-copy sends aren't supported on unix sockets
+std::pair<n3::OwnedHandle, n3::OwnedHandle> open_tcp_pair() {
+    const n3::OwnedHandle listener{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    REQUIRE(listener >= 0);
+    ::sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::bind(listener, reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(listener, 1) == 0);
+    socklen_t addr_len = sizeof(addr);
+    REQUIRE(::getsockname(listener, reinterpret_cast<::sockaddr *>(&addr), &addr_len) == 0);
+
+    n3::OwnedHandle client{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    REQUIRE(::connect(client, reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) == 0);
+    n3::OwnedHandle server{::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)};
+    REQUIRE(server >= 0);
+    return {std::move(client), std::move(server)};
+}
+
+} // namespace
+
+TEST_CASE("io_uring send_queue holds a partial zero-copy buffer until every notification") {
+    constexpr size_t PAYLOAD = 1024 * 1024;
+
+    const auto exec = make_executor();
+    const auto [sender, receiver] = open_tcp_pair();
+    //Small socket buffers, so the first send can only take part of the payload
+    const int small = 64 * 1024;
+    REQUIRE(::setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+
+    std::vector<std::byte> payload(PAYLOAD);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<std::byte>(i % 251);
+    }
+
+    n3::BufferQueue queue;
+    size_t releases = 0;
+    bool released_early = false;
+    queue.push(std::span{payload}, [&] {
+        ++releases;
+        released_early = !queue.empty() || exec->zerocopy_pending(queue);
+    });
+
+    std::vector<size_t> sent;
+    std::optional<n3::error::ErrorCode> failure;
+    bool in_flight = false;
+    const auto send_next = [&] {
+        in_flight = true;
+        exec->send_queue(sender, queue, 0, [&](std::expected<size_t, n3::error::ErrorCode> res) {
+            in_flight = false;
+            if (res.has_value()) {
+                sent.push_back(*res);
+            } else {
+                failure = res.error();
+            }
+        });
+    };
+
+    //Nobody is reading yet, so the first send stops short of the whole buffer
+    send_next();
+    for (int spin = 0; spin < 100 && in_flight; ++spin) {
+        exec->run_once();
+    }
+    REQUIRE(!in_flight);
+    if (failure.has_value()) {
+        SKIP("zero-copy send is unavailable");
+    }
+    REQUIRE(sent.size() == 1);
+    REQUIRE(sent.front() < PAYLOAD);
+    REQUIRE(releases == 0);
+
+    std::vector<std::byte> received;
+    received.reserve(PAYLOAD);
+    std::thread reader{[&] {
+        std::array<std::byte, 64 * 1024> chunk{};
+        while (received.size() < PAYLOAD) {
+            const auto ret = ::read(receiver, chunk.data(), chunk.size());
+            if (ret <= 0) {
+                return;
+            }
+            received.insert(received.end(), chunk.begin(), chunk.begin() + ret);
+        }
+    }};
+
+    for (int spin = 0; spin < 10000 && (!queue.empty() || exec->zerocopy_pending(queue)); ++spin) {
+        if (!in_flight && !queue.empty() && !failure.has_value()) {
+            send_next();
+        }
+        exec->run_once();
+    }
+    reader.join();
+
+    REQUIRE(!failure.has_value());
+    REQUIRE(sent.size() > 1);
+    REQUIRE(releases == 1);
+    REQUIRE(!released_early);
+    REQUIRE(received == payload);
+}
+
+TEST_CASE("io_uring registered_buffer_pool leases page aligned slabs and recycles them") {
+    const auto exec = make_executor();
+    const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    uring::registered_buffer_pool pool{exec->ring(), 2, page_size};
+    REQUIRE(pool.available() == 2);
+
+    {
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        REQUIRE(first.has_value());
+        REQUIRE(second.has_value());
+        REQUIRE(!pool.acquire().has_value());
+        REQUIRE(pool.available() == 0);
+
+        REQUIRE(first->index() != second->index());
+        REQUIRE(first->data().size() == page_size);
+        REQUIRE(reinterpret_cast<uintptr_t>(first->data().data()) % page_size == 0);
+        const auto slice = first->slice(16, 32);
+        REQUIRE(slice.index == first->index());
+        REQUIRE(slice.buf.data() == first->data().data() + 16);
+        REQUIRE(slice.buf.size() == 32);
+
+        first->release();
+        REQUIRE(first->data().empty());
+        REQUIRE(pool.available() == 1);
+    }
+    REQUIRE(pool.available() == 2);
+}
+
+namespace {
+
+uring::Task write_fixed_into(uring::Executor& exec,
+        const n3::Handle fd,
+        const uring::fixed_slice buf,
+        std::expected<size_t, n3::error::ErrorCode>& out) {
+    out = co_await exec.write_fixed(fd, buf);
+}
+
+uring::Task read_fixed_from(uring::Executor& exec,
+        const n3::Handle fd,
+        const uring::fixed_slice buf,
+        std::expected<size_t, n3::error::ErrorCode>& out) {
+    out = co_await exec.read_fixed(fd, buf);
+}
+
+uring::Task send_fixed_to(uring::Executor& exec,
+        const n3::Handle fd,
+        const uring::fixed_slice buf,
+        std::expected<size_t, n3::error::ErrorCode>& out) {
+    out = co_await exec.send_fixed(fd, buf);
+}
+
+} // namespace
+
+TEST_CASE("io_uring write_fixed and read_fixed round trip through a pipe") {
+    const auto exec = make_executor();
+    const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    uring::registered_buffer_pool pool{exec->ring(), 2, page_size};
+    auto out = pool.acquire();
+    auto in = pool.acquire();
+    REQUIRE(out.has_value());
+    REQUIRE(in.has_value());
+
+    std::array<int, 2> fds{};
+    REQUIRE(::pipe2(fds.data(), O_CLOEXEC) == 0);
+    const n3::OwnedHandle read_end{fds[0]};
+    const n3::OwnedHandle write_end{fds[1]};
+
+    const std::string payload = "registered";
+    std::memcpy(out->data().data(), payload.data(), payload.size());
+
+    std::expected<size_t, n3::error::ErrorCode> written
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto writer = write_fixed_into(*exec, write_end, out->slice(0, payload.size()), written);
+    writer.start();
+    run_until_done(*exec, writer);
+    REQUIRE(written.has_value());
+    REQUIRE(*written == payload.size());
+
+    std::expected<size_t, n3::error::ErrorCode> read
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto reader = read_fixed_from(*exec, read_end, *in, read);
+    reader.start();
+    run_until_done(*exec, reader);
+    REQUIRE(read.has_value());
+    REQUIRE(*read == payload.size());
+    REQUIRE(std::string(reinterpret_cast<const char *>(in->data().data()), *read) == payload);
+}
+
+TEST_CASE("io_uring send_fixed resumes only once the notification arrives") {
+    const auto exec = make_executor();
+    const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    uring::registered_buffer_pool pool{exec->ring(), 1, page_size};
+    auto slab = pool.acquire();
+    REQUIRE(slab.has_value());
+    for (size_t i = 0; i < page_size; ++i) {
+        slab->data()[i] = static_cast<std::byte>(i % 251);
+    }
+
+    const auto [sender, receiver] = open_tcp_pair();
+    const int small = 4 * 1024;
+    const int large = 1024 * 1024;
+    REQUIRE(::setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &large, sizeof(large)) == 0);
+
+    //Fill the receive window, so what's sent next sits in the send buffer with its pages pinned
+    const std::vector<std::byte> filler(64 * 1024);
+    REQUIRE(::send(sender, filler.data(), filler.size(), MSG_DONTWAIT)
+            == static_cast<ssize_t>(filler.size()));
+
+    std::expected<size_t, n3::error::ErrorCode> result
+            = std::unexpected(n3::error::get_error_code_from_errno(EINVAL));
+    auto task = send_fixed_to(*exec, sender, *slab, result);
+    task.start();
+    //The send completes right away, the notification can't until the data leaves
+    exec->run_once();
+    if (task.done()) {
+        REQUIRE(!result.has_value());
+        SKIP("zero-copy send is unavailable");
+    }
+
+    std::vector<std::byte> received(filler.size() + page_size);
+    std::thread reader{[&] {
+        size_t got = 0;
+        while (got < received.size()) {
+            const auto ret = ::read(receiver, received.data() + got, received.size() - got);
+            if (ret <= 0) {
+                return;
+            }
+            got += static_cast<size_t>(ret);
+        }
+    }};
+    run_until_done(*exec, task);
+    reader.join();
+
+    REQUIRE(result.has_value());
+    REQUIRE(*result == page_size);
+    REQUIRE(std::equal(slab->data().begin(),
+            slab->data().end(),
+            received.begin() + static_cast<std::ptrdiff_t>(filler.size())));
+}
+
+namespace {
+
+//Sets up a bare ring, skipping where io_uring itself is unavailable
+void make_handle(std::optional<uring::io_uring_handle>& handle, const uring::ring_config& config) {
+    try {
+        handle.emplace(config);
+    } catch (const n3::error::ErrorCode&) {
+        SKIP("io_uring is unavailable");
+    }
+}
+
+} // namespace
+
+TEST_CASE("io_uring_handle reports the mode that was actually set up") {
+    for (const auto requested :
+            {uring::ring_mode::sqpoll, uring::ring_mode::defer_taskrun, uring::ring_mode::plain}) {
+        std::optional<uring::io_uring_handle> handle;
+        make_handle(handle, {.mode = requested});
+
+        //The setup flags the kernel accepted are the ground truth
+        const auto flags = handle->get()->flags;
+        switch (handle->mode()) {
+            case uring::ring_mode::sqpoll:
+                REQUIRE(requested == uring::ring_mode::sqpoll);
+                REQUIRE((flags & IORING_SETUP_SQPOLL) != 0);
+                break;
+            case uring::ring_mode::defer_taskrun:
+                REQUIRE(requested != uring::ring_mode::plain);
+                REQUIRE((flags & IORING_SETUP_DEFER_TASKRUN) != 0);
+                REQUIRE((flags & IORING_SETUP_SQPOLL) == 0);
+                break;
+            case uring::ring_mode::plain:
+                REQUIRE((flags & (IORING_SETUP_SQPOLL | IORING_SETUP_DEFER_TASKRUN)) == 0);
+                break;
+        }
+    }
+}
+
+TEST_CASE("io_uring_handle without fallback sets up the requested mode or throws") {
+    std::optional<uring::io_uring_handle> plain;
+    make_handle(plain, {.mode = uring::ring_mode::plain, .fallback = false});
+    REQUIRE(plain->mode() == uring::ring_mode::plain);
+
+    for (const auto requested : {uring::ring_mode::sqpoll, uring::ring_mode::defer_taskrun}) {
+        try {
+            const uring::io_uring_handle handle{{.mode = requested, .fallback = false}};
+            REQUIRE(handle.mode() == requested);
+        } catch (const n3::error::ErrorCode&) {
+            //Rejected by this kernel or these privileges, which is fine as long as it's loud
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <netinet/in.h>
+#include <set>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+#include "address.h"
+#include "handle.h"
+#include "runtime.h"
+#include "scheduler.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+//Fire and forget coroutine, created suspended and destroys itself once resumed to the end
+struct detached {
+    struct promise_type {
+        detached get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {
+        }
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+//Offloads a section, then has to come back to the accepting worker before touching its executor
+detached offload_and_return(n3::scheduler::work_stealing_scheduler& sched,
+        std::atomic<int>& misplaced,
+        std::atomic<size_t>& completed) {
+    const auto thread = std::this_thread::get_id();
+    const auto home = co_await sched.offload();
+    if (!home) {
+        misplaced.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        co_await sched.resume_on(*home);
+        misplaced.fetch_add(std::this_thread::get_id() != thread, std::memory_order_relaxed);
+    }
+    completed.fetch_add(1, std::memory_order_release);
+}
+
+::sockaddr_in loopback_any() {
+    ::sockaddr_in any{};
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return any;
+}
+
+} // namespace
+
+TEST_CASE("runtime_mt accepts connections on every shard's port and stops cleanly") {
+    constexpr size_t WORKERS = 4;
+    constexpr size_t CLIENTS = 16;
+
+    n3::runtime::runtime_mt runtime{WORKERS};
+    REQUIRE(runtime.size() == WORKERS);
+
+    std::atomic<size_t> accepted{0};
+    std::mutex threads_lock;
+    std::set<std::thread::id> accepting_threads;
+
+    const auto bound = runtime.listen(n3::net::v4::address{loopback_any()},
+            [&](n3::linux::epoll::epoll_executor&, const n3::Handle fd, const auto&) {
+                const n3::OwnedHandle conn{fd};
+                {
+                    const std::lock_guard lock{threads_lock};
+                    accepting_threads.insert(std::this_thread::get_id());
+                }
+                accepted.fetch_add(1, std::memory_order_release);
+            });
+    REQUIRE(bound.has_value());
+    REQUIRE(std::holds_alternative<n3::net::v4::address>(*bound));
+    const auto server = std::get<n3::net::v4::address>(*bound).to_sockaddr();
+    REQUIRE(server.sin_port != 0);
+
+    std::jthread runner{[&] { runtime.run(); }};
+
+    //Kept open until the test ends, a client closing first could be accepted after the check
+    std::vector<n3::OwnedHandle> clients;
+    clients.reserve(CLIENTS);
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        clients.emplace_back(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        REQUIRE(clients.back() >= 0);
+        REQUIRE(::connect(clients.back(),
+                        reinterpret_cast<const ::sockaddr *>(&server),
+                        sizeof(server))
+                == 0);
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (accepted.load(std::memory_order_acquire) < CLIENTS
+            && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    REQUIRE(accepted.load(std::memory_order_acquire) == CLIENTS);
+
+    //Stopped from a thread that isn't running any worker
+    std::jthread{[&] { runtime.stop(); }}.join();
+    runner.join();
+
+    const std::lock_guard lock{threads_lock};
+    REQUIRE(!accepting_threads.empty());
+    REQUIRE(accepting_threads.count(std::this_thread::get_id()) == 0);
+}
+
+TEST_CASE("runtime_mt with work stealing resumes offloaded work on the accepting worker") {
+    constexpr size_t WORKERS = 4;
+    constexpr size_t CLIENTS = 16;
+
+    n3::runtime::runtime_mt runtime{WORKERS, true};
+    REQUIRE(runtime.scheduler() != nullptr);
+    REQUIRE(runtime.scheduler()->size() == WORKERS);
+
+    std::atomic<int> misplaced{0};
+    std::atomic<size_t> completed{0};
+
+    const auto bound = runtime.listen(n3::net::v4::address{loopback_any()},
+            [&](n3::linux::epoll::epoll_executor&, const n3::Handle fd, const auto&) {
+                const n3::OwnedHandle conn{fd};
+                auto& sched = *runtime.scheduler();
+                sched.schedule(offload_and_return(sched, misplaced, completed).handle);
+            });
+    REQUIRE(bound.has_value());
+    const auto server = std::get<n3::net::v4::address>(*bound).to_sockaddr();
+
+    std::jthread runner{[&] { runtime.run(); }};
+
+    std::vector<n3::OwnedHandle> clients;
+    clients.reserve(CLIENTS);
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        clients.emplace_back(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        REQUIRE(clients.back() >= 0);
+        REQUIRE(::connect(clients.back(),
+                        reinterpret_cast<const ::sockaddr *>(&server),
+                        sizeof(server))
+                == 0);
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (completed.load(std::memory_order_acquire) < CLIENTS
+            && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    runtime.stop();
+    runner.join();
+
+    REQUIRE(completed.load(std::memory_order_acquire) == CLIENTS);
+    REQUIRE(misplaced.load() == 0);
+}
@@ -0,0 +1,333 @@
+#include <array>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace {
+
+//Stand-in handles, the deque only stores and returns addresses so these are never resumed
+std::coroutine_handle<> fake_handle(std::byte& slot) {
+    return std::coroutine_handle<>::from_address(&slot);
+}
+
+//Fire and forget coroutine, created suspended and destroys itself once resumed to the end
+struct detached {
+    struct promise_type {
+        detached get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {
+        }
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+detached count_run(std::atomic<int>& runs) {
+    runs.fetch_add(1, std::memory_order_relaxed);
+    co_return;
+}
+
+detached count_run(std::atomic<int>& runs, std::atomic<size_t>& completed) {
+    runs.fetch_add(1, std::memory_order_relaxed);
+    completed.fetch_add(1, std::memory_order_release);
+    co_return;
+}
+
+//Records whether it ran on the expected worker
+detached run_on(n3::scheduler::work_stealing_scheduler& sched,
+        const size_t expected,
+        std::atomic<int>& misplaced,
+        std::atomic<size_t>& completed) {
+    misplaced.fetch_add(sched.current() != expected, std::memory_order_relaxed);
+    completed.fetch_add(1, std::memory_order_release);
+    co_return;
+}
+
+//Offloads so any worker may pick it up, then hops back to where it started
+detached offload_and_return(n3::scheduler::work_stealing_scheduler& sched,
+        std::atomic<int>& misplaced,
+        std::atomic<size_t>& completed) {
+    const auto home = co_await sched.offload();
+    if (!home) {
+        misplaced.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        co_await sched.resume_on(*home);
+        misplaced.fetch_add(sched.current() != home, std::memory_order_relaxed);
+    }
+    completed.fetch_add(1, std::memory_order_release);
+}
+
+detached hop_to(n3::scheduler::work_stealing_scheduler& sched,
+        const size_t worker,
+        std::atomic<int>& misplaced,
+        std::atomic<size_t>& completed) {
+    co_await sched.resume_on(worker);
+    misplaced.fetch_add(sched.current() != worker, std::memory_order_relaxed);
+    completed.fetch_add(1, std::memory_order_release);
+}
+
+} // namespace
+
+TEST_CASE("work_deque owner pops LIFO and thieves steal FIFO") {
+    n3::scheduler::work_deque deque{};
+    std::array<std::byte, 4> slots{};
+
+    REQUIRE(deque.empty());
+    REQUIRE(!deque.pop());
+    REQUIRE(!deque.steal());
+
+    for (auto& slot : slots) {
+        REQUIRE(deque.push(fake_handle(slot)));
+    }
+    //Owner takes the newest, thieves take the oldest
+    REQUIRE(deque.pop() == fake_handle(slots[3]));
+    REQUIRE(deque.steal() == fake_handle(slots[0]));
+    REQUIRE(deque.pop() == fake_handle(slots[2]));
+    REQUIRE(deque.steal() == fake_handle(slots[1]));
+
+    REQUIRE(deque.empty());
+    REQUIRE(!deque.pop());
+    REQUIRE(!deque.steal());
+}
+
+TEST_CASE("work_deque push fails once full and recovers after a steal") {
+    constexpr auto CAPACITY = n3::scheduler::work_deque::capacity();
+    auto deque = std::make_unique<n3::scheduler::work_deque>();
+    std::vector<std::byte> slots(CAPACITY + 1);
+
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        REQUIRE(deque->push(fake_handle(slots[i])));
+    }
+    REQUIRE(!deque->push(fake_handle(slots[CAPACITY])));
+
+    //A steal frees the slot at the top, which the wrapped bottom reuses
+    REQUIRE(deque->steal() == fake_handle(slots[0]));
+    REQUIRE(deque->push(fake_handle(slots[CAPACITY])));
+    REQUIRE(!deque->push(fake_handle(slots[0])));
+
+    REQUIRE(deque->pop() == fake_handle(slots[CAPACITY]));
+    for (size_t i = CAPACITY - 1; i > 0; --i) {
+        REQUIRE(deque->pop() == fake_handle(slots[i]));
+    }
+    REQUIRE(deque->empty());
+}
+
+TEST_CASE("work_deque hands every item to exactly one of the owner and thieves") {
+    constexpr size_t ITEMS = 200'000;
+    constexpr size_t THIEVES = 3;
+
+    auto deque = std::make_unique<n3::scheduler::work_deque>();
+    std::vector<std::byte> slots(ITEMS);
+    std::vector<std::atomic<int>> taken(ITEMS);
+    std::atomic<bool> done{false};
+
+    const auto record = [&](const std::coroutine_handle<> h) {
+        const auto idx = static_cast<size_t>(static_cast<std::byte *>(h.address()) - slots.data());
+        taken[idx].fetch_add(1, std::memory_order_relaxed);
+    };
+
+    std::vector<std::jthread> thieves;
+    for (size_t i = 0; i < THIEVES; ++i) {
+        thieves.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire) || !deque->empty()) {
+                if (const auto h = deque->steal()) {
+                    record(h);
+                }
+            }
+        });
+    }
+
+    //Owner pushes everything, popping some along the way so both ends stay contended
+    for (size_t i = 0; i < ITEMS; ++i) {
+        while (!deque->push(fake_handle(slots[i]))) {
+            if (const auto h = deque->pop()) {
+                record(h);
+            }
+        }
+        if (i % 3 == 0) {
+            if (const auto h = deque->pop()) {
+                record(h);
+            }
+        }
+    }
+    while (const auto h = deque->pop()) {
+        record(h);
+    }
+    done.store(true, std::memory_order_release);
+    thieves.clear();
+
+    size_t wrong = 0;
+    for (const auto& count : taken) {
+        wrong += (count.load(std::memory_order_relaxed) != 1);
+    }
+    REQUIRE(wrong == 0);
+}
+
+TEST_CASE("work_stealing_scheduler falls back to pinned when the deque is full") {
+    constexpr auto ITEMS = n3::scheduler::work_deque::capacity() + 16;
+
+    n3::scheduler::work_stealing_scheduler sched{1, {}};
+    sched.bind(0);
+
+    std::atomic<int> runs{0};
+    for (size_t i = 0; i < ITEMS; ++i) {
+        sched.schedule(count_run(runs).handle, n3::scheduler::affinity::stealable);
+    }
+    REQUIRE(sched.has_local_work());
+    while (sched.run_one()) {
+    }
+    REQUIRE(runs.load() == static_cast<int>(ITEMS));
+    REQUIRE(!sched.has_local_work());
+}
+
+TEST_CASE("work_stealing_scheduler runs offloaded work exactly once across workers") {
+    constexpr size_t WORKERS = 4;
+    constexpr size_t ITEMS = 2000;
+
+    n3::scheduler::work_stealing_scheduler sched{WORKERS, {}};
+    std::vector<std::atomic<int>> runs(ITEMS);
+    std::atomic<size_t> completed{0};
+    std::atomic<bool> queued{false};
+
+    const auto drain = [&] {
+        while (!queued.load(std::memory_order_acquire) || completed.load() < ITEMS) {
+            if (!sched.run_one()) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::vector<std::jthread> peers;
+    for (size_t w = 1; w < WORKERS; ++w) {
+        peers.emplace_back([&, w] {
+            sched.bind(w);
+            drain();
+        });
+    }
+
+    sched.bind(0);
+    for (size_t i = 0; i < ITEMS; ++i) {
+        sched.schedule(count_run(runs[i], completed).handle, n3::scheduler::affinity::stealable);
+    }
+    queued.store(true, std::memory_order_release);
+    drain();
+    peers.clear();
+
+    size_t wrong = 0;
+    for (const auto& run : runs) {
+        wrong += (run.load(std::memory_order_relaxed) != 1);
+    }
+    REQUIRE(wrong == 0);
+}
+
+TEST_CASE("work_stealing_scheduler never lets peers steal pinned work") {
+    constexpr size_t ITEMS = 256;
+
+    n3::scheduler::work_stealing_scheduler sched{2, {}};
+    std::atomic<int> misplaced{0};
+    std::atomic<size_t> completed{0};
+
+    sched.bind(0);
+    for (size_t i = 0; i < ITEMS; ++i) {
+        sched.schedule(run_on(sched, 0, misplaced, completed).handle);
+    }
+
+    //The peer has nothing of its own and the owner isn't draining, so any run would be a steal
+    std::atomic<int> stolen{0};
+    std::jthread{[&] {
+        sched.bind(1);
+        for (size_t i = 0; i < 10'000; ++i) {
+            stolen.fetch_add(sched.run_one(), std::memory_order_relaxed);
+        }
+    }}.join();
+    REQUIRE(stolen.load() == 0);
+    REQUIRE(completed.load() == 0);
+
+    while (sched.run_one()) {
+    }
+    REQUIRE(completed.load() == ITEMS);
+    REQUIRE(misplaced.load() == 0);
+}
+
+TEST_CASE("work_stealing_scheduler resume_on returns offloaded work to its home worker") {
+    constexpr size_t WORKERS = 4;
+    constexpr size_t ITEMS = 2000;
+
+    n3::scheduler::work_stealing_scheduler sched{WORKERS, {}};
+    std::atomic<int> misplaced{0};
+    std::atomic<size_t> completed{0};
+    std::atomic<bool> queued{false};
+
+    const auto drain = [&] {
+        while (!queued.load(std::memory_order_acquire) || completed.load() < ITEMS) {
+            if (!sched.run_one()) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::vector<std::jthread> peers;
+    for (size_t w = 1; w < WORKERS; ++w) {
+        peers.emplace_back([&, w] {
+            sched.bind(w);
+            drain();
+        });
+    }
+
+    sched.bind(0);
+    for (size_t i = 0; i < ITEMS; ++i) {
+        sched.schedule(offload_and_return(sched, misplaced, completed).handle);
+    }
+    queued.store(true, std::memory_order_release);
+    drain();
+    peers.clear();
+
+    REQUIRE(completed.load() == ITEMS);
+    REQUIRE(misplaced.load() == 0);
+}
+
+TEST_CASE("work_stealing_scheduler resume_on from an unbound thread lands on the worker") {
+    n3::scheduler::work_stealing_scheduler sched{2, {}};
+    std::atomic<int> misplaced{0};
+    std::atomic<size_t> completed{0};
+
+    //Started outside the scheduler, the coroutine suspends into worker 1's inbox
+    bool was_unbound = false;
+    std::jthread{[&] {
+        was_unbound = !sched.current();
+        hop_to(sched, 1, misplaced, completed).handle.resume();
+    }}.join();
+    REQUIRE(was_unbound);
+    REQUIRE(completed.load() == 0);
+
+    sched.bind(0);
+    REQUIRE(!sched.run_one());
+
+    bool had_work = false;
+    std::jthread{[&] {
+        sched.bind(1);
+        had_work = sched.has_local_work();
+        while (sched.run_one()) {
+        }
+    }}.join();
+    REQUIRE(had_work);
+    REQUIRE(completed.load() == 1);
+    REQUIRE(misplaced.load() == 0);
+}
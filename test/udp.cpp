@@ -0,0 +1,112 @@
+#include <arpa/inet.h>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <variant>
+
+#include "address.h"
+#include "buffer.h"
+#include "udp.h"
+
+namespace {
+n3::net::v4::address loopback() {
+    ::sockaddr_in raw{};
+    raw.sin_family = AF_INET;
+    raw.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return {raw};
+}
+
+n3::net::v4::address local_address(const n3::net::linux::udp::UdpSocket& sock) {
+    ::sockaddr_in raw{};
+    socklen_t len = sizeof(raw);
+    REQUIRE(::getsockname(sock.native_handle(), reinterpret_cast<::sockaddr *>(&raw), &len)
+            == 0);
+    return {raw};
+}
+} // namespace
+
+TEST_CASE("UdpSocket batches datagrams through sendmmsg and recvmmsg") {
+    using namespace n3::net::linux::udp;
+
+    const UdpSocket rx{loopback()};
+    const UdpSocket tx{loopback()};
+    const auto rx_addr = local_address(rx);
+
+    //Nothing queued yet, the socket is non-blocking
+    RecvBatch received{8, 16};
+    REQUIRE_FALSE(rx.recv_batch(received).has_value());
+
+    std::array<std::array<std::byte, 4>, 5> payloads{};
+    SendBatch batch{6};
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        payloads[i].fill(static_cast<std::byte>(i));
+        REQUIRE(batch.push(std::span<std::byte>{payloads[i]}, rx_addr));
+    }
+    //Bigger than a receive slot, has to come back truncated
+    std::array<std::byte, 32> oversized{};
+    REQUIRE(batch.push(std::span<std::byte>{oversized}, rx_addr));
+    REQUIRE(batch.full());
+    REQUIRE_FALSE(batch.push(std::span<std::byte>{oversized}, rx_addr));
+
+    const auto sent = tx.send_batch(batch);
+    REQUIRE(sent.has_value());
+    REQUIRE(*sent == 6);
+    REQUIRE(batch.empty());
+
+    const auto got = rx.recv_batch(received);
+    REQUIRE(got.has_value());
+    REQUIRE(*got == 6);
+    REQUIRE(received.size() == 6);
+
+    const auto tx_port = local_address(tx).to_sockaddr().sin_port;
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        const auto data = received.payload(i);
+        REQUIRE(data.size() == 4);
+        REQUIRE(data.data()[0] == static_cast<std::byte>(i));
+        REQUIRE_FALSE(received.truncated(i));
+        const auto from = received.source(i);
+        REQUIRE(std::holds_alternative<n3::net::v4::address>(from));
+        REQUIRE(std::get<n3::net::v4::address>(from).to_sockaddr().sin_port == tx_port);
+    }
+    REQUIRE(received.payload(5).size() == 16);
+    REQUIRE(received.truncated(5));
+}
+
+TEST_CASE("UdpSocket sends with GSO and splits GRO receives back into segments") {
+    using namespace n3::net::linux::udp;
+
+    const UdpSocket rx{loopback()};
+    const UdpSocket tx{loopback()};
+    REQUIRE(rx.set_gro(true).has_value());
+
+    //Four full segments and a short one in a single send
+    std::array<std::byte, 4 * 1000 + 500> data{};
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<std::byte>(i / 1000);
+    }
+    const auto sent = tx.send_segmented(std::span<std::byte>{data}, 1000, local_address(rx));
+    REQUIRE(sent.has_value());
+    REQUIRE(*sent == data.size());
+
+    //GRO may hand these back coalesced or one at a time, either way the segments line up
+    SegmentedRecv buf{};
+    size_t received = 0;
+    size_t segments = 0;
+    while (received < data.size()) {
+        const auto got = rx.recv_segmented(buf);
+        REQUIRE(got.has_value());
+        REQUIRE_FALSE(buf.truncated());
+        for (const auto segment : buf.segments()) {
+            REQUIRE(segment.size() == (segments < 4 ? 1000 : 500));
+            REQUIRE(segment.data()[0] == static_cast<std::byte>(segments));
+            received += segment.size();
+            ++segments;
+        }
+    }
+    REQUIRE(received == data.size());
+    REQUIRE(segments == 5);
+}